@@ -19,10 +19,8 @@ int main(int argc, char *argv[])
 	double		  R		 = (argc == 3) ? atof(argv[2]) : 3.102;		// So the hexagon area will be 25 pixels;
 	CCell		  cell(img, R);   
 	CMarker		  marker;        
-	cell_params	  params = cell.getInfo();        
 	
-	for (int n = 0; n < params.N; n++)        
-		marker.markHexagon(img, R, n, cell.getVal(n));     
+	marker.markHexagons(img, cell);
 	
 //	marker->markGrid(img, R, CV_RGB(0, 128, 64));    
 	
@@ -0,0 +1,213 @@
+// Regression tests of the hCell library
+// The library sources are compiled into the test application, thus the replaced global operator new counts the library allocations as well
+#include "hCell.h"
+#include "macroses.h"
+#include <atomic>
+#include <new>
+
+using namespace HexagonCells;
+
+namespace {
+	std::atomic<long> nAllocs(0);		// number of the operator new calls
+	std::atomic<long> nMats(0);			// number of the allocated Mat buffers
+
+	// The Mat buffers are allocated by the OpenCV library, thus they are counted by the default Mat allocator
+	class CCountingAllocator : public MatAllocator
+	{
+	public:
+		UMatData	* allocate(int dims, const int *sizes, int type, void *data, size_t *step, int flags, UMatUsageFlags usageFlags) const
+		{
+			nMats++;
+			return Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+		}
+		bool		  allocate(UMatData *data, int accessFlags, UMatUsageFlags usageFlags) const { return Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags); }
+		void		  deallocate(UMatData *data) const { Mat::getStdAllocator()->deallocate(data); }
+	};
+
+	Mat getRandomImage(CvSize size, int type)
+	{
+		Mat res(size, type);
+		for (int y = 0; y < res.rows; y++) {
+			byte *pRes = res.ptr<byte>(y);
+			for (size_t i = 0; i < res.cols * res.elemSize(); i++) pRes[i] = static_cast<byte>(rand() % 7 * 30);
+		}
+		return res;
+	}
+
+	// After the first frame, the frames of the same size are processed without new allocations
+	int testAllocations(void)
+	{
+		const int		nFrames = 8;
+		const CvSize	size	= cvSize(320, 240);
+		const double	R		= 3.7;
+		const char		*names[] = { "CELL_AVG", "CELL_MV", "CELL_AVG with prefix sums", "CELL_AVG with statistics", "CELL_AVG with an own image copy" };
+		const int		nModes	= sizeof(names) / sizeof(names[0]);
+
+		std::vector<Mat> vFrames(nFrames);
+		for (Mat &frame : vFrames) frame = getRandomImage(size, CV_8UC3);
+
+		int nErrors = 0;
+		for (int mode = 0; mode < nModes; mode++) {
+			CCell cell(size, R, (mode == 1) ? CELL_MV : CELL_AVG);
+			if (mode == 2) cell.setPrefixSums(true);
+			if (mode == 3) cell.setStatistics(CELL_STAT_MIN | CELL_STAT_MAX | CELL_STAT_COUNT);
+
+			Mat	vals;
+			int	vNeighbours[6];
+			for (int f = 0; f < nFrames; f++) {
+				nAllocs = 0;
+				nMats	= 0;
+				if (mode == 4) cell.setImage(vFrames[f]);
+				else		   cell.bindImage(vFrames[f]);
+				cell.getVals(vals);
+				for (int idx = 0; idx < vals.cols; idx += 97) cell.getNeighbourhood(idx, vNeighbours);
+				if (f == 0) continue;				// the first frame allocates the buffers
+				if ((nAllocs != 0) || (nMats != 0)) {
+					printf("testAllocations: %s: frame %d: %ld operator new calls, %ld Mat buffers\n", names[mode], f, (long)nAllocs, (long)nMats);
+					nErrors++;
+				}
+			} // f
+		} // mode
+		return nErrors;
+	}
+
+	// Original per-pixel look-up table builder: the containment of the pixel in the six triangles of the candidate cell
+	bool ifInsideTriangle(CvPoint2D64f x, CvPoint2D64f a, CvPoint2D64f b, CvPoint2D64f c)
+	{
+		double r1 = (a.x - x.x) * (b.y - a.y) - (b.x - a.x) * (a.y - x.y);
+		double r2 = (b.x - x.x) * (c.y - b.y) - (c.x - b.x) * (b.y - x.y);
+		double r3 = (c.x - x.x) * (a.y - c.y) - (a.x - c.x) * (c.y - x.y);
+		return (SIGN(r1) == SIGN(r2)) && (SIGN(r3) == 1);		// the original test SIGN(r1) == SIGN(r2) == SIGN(r3)
+	}
+
+	CvPoint2D64f getBoundaryPoint(CvPoint2D64f C, int i, double R)
+	{
+		double r = 0.5 * sqrt(3.0) * R;
+		switch (i) {
+		case 0:		return cvPoint2D64f(C.x, C.y - R);
+		case 1:		return cvPoint2D64f(C.x + r, C.y - 0.5*R);
+		case 2:		return cvPoint2D64f(C.x + r, C.y + 0.5*R);
+		case 3:		return cvPoint2D64f(C.x, C.y + R);
+		case 4:		return cvPoint2D64f(C.x - r, C.y + 0.5*R);
+		case 5:		return cvPoint2D64f(C.x - r, C.y - 0.5*R);
+		default:	return cvPoint2D64f(0, 0);
+		}
+	}
+
+	Mat getReferenceLUT(CvSize imgSize, double R)
+	{
+		double	r		 = 0.5 * sqrt(3.0) * R;
+		double	dx		 = 2.0 * r;				// x - distance between cells
+		double	dy		 = 1.5 * R;				// y - distance between cells
+		double	imgWidth = static_cast<double>(imgSize.width);
+		int		width0	 = static_cast<int> (0.99 + imgWidth / dx);
+		int		width1	 = 1 + static_cast<int> (0.99 + (imgWidth - r) / dx);
+
+		Mat res(imgSize, CV_32SC1);
+		for (int y = 0; y < res.rows; y++) {
+			int *pRes = res.ptr<int>(y);
+			for (int x = 0; x < res.cols; x++) {
+				CvPoint2D64f X = cvPoint2D64f(x, y);
+				Point		 c(static_cast<int>(X.x / dx), static_cast<int>((X.y + 0.5 * R) / dy));
+				CvPoint2D64f C = cvPoint2D64f(c.x * dx + r, c.y * dy + 0.5 * R);
+
+				if ((c.y % 2) == 1) X.x += r;
+				bool inside = false;
+				for (int i = 0; (i < 6) && !inside; i++) inside = ifInsideTriangle(X, C, getBoundaryPoint(C, i, R), getBoundaryPoint(C, (i + 1) % 6, R));
+				if (!inside) {
+					if ((c.y % 2) == 0) { if (X.x >= C.x) c.x++; }
+					else				{ if (X.x < C.x) c.x--; }
+					c.y--;
+				}
+				int a = c.y / 2;
+				int b = c.y - 2 * a;
+				pRes[x] = a * (width0 + width1) + ((b == 1) ? width0 : 0) + c.x;
+			} // x
+		} // y
+		return res;
+	}
+
+	// The closed-form look-up table builder (scalar and AVX2 code paths) reproduces the original per-pixel builder:
+	// the dense look-up table is built with CCell, the streamed rows are built with CCellStream
+	int testLUT(void)
+	{
+		const int		nTests	  = 50;
+		const double	vR[]	  = { 1.0, 1.5, 2.0, 3.0, 4.0, 2.0 / sqrt(3.0), 4.0 / sqrt(3.0) };	// many pixels lie on the cell boundaries
+		const int		nFixed	  = sizeof(vR) / sizeof(vR[0]);
+		const bool		optimized = useOptimized();
+
+		int nErrors = 0;
+		for (int t = 0; t < nTests; t++) {
+			CvSize	size = cvSize(1 + rand() % 400, 1 + rand() % 300);
+			double	R	 = (t < nFixed) ? vR[t] : MIN_RADIUS + 19.0 * rand() / RAND_MAX;
+			Mat		ref	 = getReferenceLUT(size, R);
+
+			// Every pixel is labelled with (idx + 1, (idx + 1)^2) of its reference cell, thus the streamed cell k has the value
+			// (k + 1, (k + 1)^2) if, and only if all its pixels belong to it in the reference, and the value (0, 0) if it has no pixels
+			int	nCells = 0;
+			Mat	labels(size, CV_64FC2);
+			for (int y = 0; y < size.height; y++)
+				for (int x = 0; x < size.width; x++) {
+					double l = ref.at<int>(y, x) + 1.0;
+					labels.ptr<double>(y)[2 * x]	 = l;
+					labels.ptr<double>(y)[2 * x + 1] = l * l;
+					nCells = MAX(nCells, ref.at<int>(y, x) + 1);
+				}
+			std::vector<bool> vEmpty(nCells, true);
+			for (int y = 0; y < size.height; y++)
+				for (int x = 0; x < size.width; x++) vEmpty[ref.at<int>(y, x)] = false;
+
+			for (int pass = 0; pass < 2; pass++) {
+				setUseOptimized(pass == 0);
+				CLUTCache::getInstance().clear();		// the look-up table is built anew for every code path
+
+				CCell	cell(size, R);
+				Mat		lut = cell.getLUT();
+				int		nDiffs = 0;
+				for (int y = 0; y < size.height; y++)
+					for (int x = 0; x < size.width; x++) if (lut.at<int>(y, x) != ref.at<int>(y, x)) nDiffs++;
+
+				CCellStream stream(size, R);
+				Mat			vals = stream.addStrip(labels);
+				if (vals.cols != nCells) nDiffs++;
+				else for (int k = 0; k < nCells; k++) {
+					double l = vEmpty[k] ? 0 : k + 1.0;
+					if ((vals.ptr<double>(0)[2 * k] != l) || (vals.ptr<double>(0)[2 * k + 1] != l * l)) nDiffs++;
+				}
+
+				if (nDiffs) {
+					printf("testLUT: %dx%d, R = %.6f, %s: %d differences\n", size.width, size.height, R, pass ? "scalar" : "AVX2", nDiffs);
+					nErrors++;
+				}
+			} // pass
+		} // t
+		setUseOptimized(optimized);
+		CLUTCache::getInstance().clear();
+		return nErrors;
+	}
+}
+
+void * operator new(size_t size)
+{
+	nAllocs++;
+	void *p = malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+void * operator new[](size_t size)	{ return operator new(size); }
+void operator delete(void *p) noexcept	{ free(p); }
+void operator delete[](void *p) noexcept	{ operator delete(p); }
+
+int main(int argc, char *argv[])
+{
+	CCountingAllocator allocator;
+	Mat::setDefaultAllocator(&allocator);
+
+	int nErrors = 0;
+	nErrors += testAllocations();
+	nErrors += testLUT();
+
+	Mat::setDefaultAllocator(NULL);
+	printf(nErrors ? "FAILED: %d errors\n" : "PASSED\n", nErrors);
+	return nErrors ? 1 : 0;
+}
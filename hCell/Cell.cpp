@@ -1,38 +1,42 @@
 #include "Cell.h"
+#include "CellReader.h"
+#include "Voter.h"
 #include "macroses.h"
 #include "core\core.hpp"
+#include <algorithm>
+#include <limits>
 
 namespace HexagonCells
 {
 	// Default Constructor
-	CCell::CCell(void) : m_img(Mat()), m_imgSize(cvSize(0, 0)), m_LUT(Mat()), m_R(-1.0), m_r(-1.0), m_nCells(-1), m_cellIntApp(CELL_AVG), m_cellData(Mat())
+	CCell::CCell(void) : m_img(Mat()), m_imgSize(cvSize(0, 0)), m_LUT(Mat()), m_R(-1.0), m_r(-1.0), m_nCells(-1), m_cellIntApp(CELL_AVG), m_cellStats(0), m_usePrefix(false), m_imgView(false), m_cellData(Mat())
 	{
 	}
 
 	// Constructor
-	CCell::CCell(CvSize imgSize, cell_int_app cellIntApp) : m_img(Mat()), m_imgSize(imgSize), m_LUT(Mat()), m_R(-1.0), m_r(-1.0), m_nCells(-1), m_cellIntApp(cellIntApp), m_cellData(Mat())
+	CCell::CCell(CvSize imgSize, cell_int_app cellIntApp) : m_img(Mat()), m_imgSize(imgSize), m_LUT(Mat()), m_R(-1.0), m_r(-1.0), m_nCells(-1), m_cellIntApp(cellIntApp), m_cellStats(0), m_usePrefix(false), m_imgView(false), m_cellData(Mat())
 	{
 	}
 
 	// Constructor
-	CCell::CCell(Mat &img, cell_int_app cellIntApp) : m_LUT(Mat()), m_R(-1.0), m_r(-1.0), m_nCells(-1), m_cellIntApp(cellIntApp), m_cellData(Mat())
+	CCell::CCell(Mat &img, cell_int_app cellIntApp) : m_LUT(Mat()), m_R(-1.0), m_r(-1.0), m_nCells(-1), m_cellIntApp(cellIntApp), m_cellStats(0), m_usePrefix(false), m_imgView(false), m_cellData(Mat())
 	{
 		img.copyTo(m_img);
 		m_imgSize = img.size();
 	}
 
 	// Constructor
-	CCell::CCell(double R) : m_img(Mat()), m_imgSize(cvSize(0, 0)), m_LUT(Mat()), m_R(R), m_r(0.5*sqrt(3.0)*R), m_nCells(-1), m_cellIntApp(CELL_AVG), m_cellData(Mat())
+	CCell::CCell(double R) : m_img(Mat()), m_imgSize(cvSize(0, 0)), m_LUT(Mat()), m_R(R), m_r(0.5*sqrt(3.0)*R), m_nCells(-1), m_cellIntApp(CELL_AVG), m_cellStats(0), m_usePrefix(false), m_imgView(false), m_cellData(Mat())
 	{
 	}
 
 	// Constructor
-	CCell::CCell(CvSize imgSize, double R, cell_int_app cellIntApp) : m_img(Mat()), m_imgSize(imgSize), m_LUT(Mat()), m_R(R), m_r(0.5*sqrt(3.0)*R), m_nCells(-1), m_cellIntApp(cellIntApp), m_cellData(Mat())
+	CCell::CCell(CvSize imgSize, double R, cell_int_app cellIntApp) : m_img(Mat()), m_imgSize(imgSize), m_LUT(Mat()), m_R(R), m_r(0.5*sqrt(3.0)*R), m_nCells(-1), m_cellIntApp(cellIntApp), m_cellStats(0), m_usePrefix(false), m_imgView(false), m_cellData(Mat())
 	{
 	}
 
 	// Constructor
-	CCell::CCell(Mat &img, double R, cell_int_app cellIntApp) : m_LUT(Mat()), m_R(R), m_r(0.5*sqrt(3.0)*R), m_nCells(-1), m_cellIntApp(cellIntApp), m_cellData(Mat())
+	CCell::CCell(Mat &img, double R, cell_int_app cellIntApp) : m_LUT(Mat()), m_R(R), m_r(0.5*sqrt(3.0)*R), m_nCells(-1), m_cellIntApp(cellIntApp), m_cellStats(0), m_usePrefix(false), m_imgView(false), m_cellData(Mat())
 	{
 		img.copyTo(m_img);
 		m_imgSize = img.size();
@@ -43,18 +47,37 @@ namespace HexagonCells
 	{
 		if (!m_img.empty()) m_img.release();
 		if (!m_LUT.empty()) m_LUT.release();
+		m_pLUT.reset();
+		if (!m_adjacency.empty()) m_adjacency.release();
+		if (!m_cellSpans.empty()) { m_cellOffsets.release(); m_cellSpans.release(); }
+		if (!m_prefix.empty()) m_prefix.release();
 		if (!m_cellData.empty()) m_cellData.release();
+		if (!m_cellSum.empty()) m_cellSum.release();
+		if (!m_sparseData.empty()) { m_sparseData.release(); m_sparseMask.release(); }
+		releaseStats();
 	}
 
 	void CCell::clear(void)
 	{
 		if (!m_img.empty()) m_img.release();
+		m_imgView = false;
 		m_imgSize = cvSize(0, 0);
 		if (!m_LUT.empty()) m_LUT.release();
+		m_pLUT.reset();
 		m_R = -1.0;
 		m_r = -1.0;
+		m_nCells = -1;
+		if (!m_adjacency.empty()) m_adjacency.release();
+		if (!m_cellSpans.empty()) { m_cellOffsets.release(); m_cellSpans.release(); }
 		m_cellIntApp = CELL_AVG;
+		m_cellStats = 0;
+		m_usePrefix = false;
+		if (!m_prefix.empty()) m_prefix.release();
 		if (!m_cellData.empty()) m_cellData.release();
+		if (!m_cellSum.empty()) m_cellSum.release();
+		if (!m_sparseData.empty()) { m_sparseData.release(); m_sparseMask.release(); }
+		releaseStats();
+		m_pScratch.reset();
 	}
 
 	void CCell::setImage(Mat &img)
@@ -62,15 +85,132 @@ namespace HexagonCells
 		// Assertions
 		HCELL_ASSERT_MSG(!img.empty(), "The image is not set");
 
-		if (!m_img.empty()) m_img.release();
+		if (m_imgView) m_img.release();								// the own copy keeps its buffer, if the size and type are the same
 		img.copyTo(m_img);
+		m_imgView = false;
+		setImageSize(img.size());
+	}
 
-		if ((m_imgSize.width != img.size().width) || (m_imgSize.height != img.size().height)) {		// if new size
-			if (!m_LUT.empty()) m_LUT.release();													// release LUT
-			m_nCells = -1;																			// reset nCells;
+	void CCell::bindImage(const Mat &img)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(!img.empty(), "The image is not set");
+
+		m_img = img;
+		m_imgView = true;
+		setImageSize(img.size());
+	}
+
+	void CCell::bindImage(const void *pData, CvSize size, int type, size_t step)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(pData != NULL, "The image is not set");
+
+		bindImage(Mat(size, type, const_cast<void *>(pData), (step == 0) ? Mat::AUTO_STEP : step));
+	}
+
+	void CCell::updateImage(const Mat &img, const std::vector<Rect> &vRects)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(!m_img.empty(), "The image is not set");
+		HCELL_ASSERT_MSG((img.size() == m_img.size()) && (img.type() == m_img.type()), "The updated image must have the same size and type as the current image");
+
+		const bool inPlace = img.data == m_img.data;								// the old pixels are not available
+		const Rect imgRect(0, 0, img.cols, img.rows);
+		releasePrefix();
+
+		// The statistics and the not yet calculated cells are calculated lazily from the whole image
+		if (m_cellData.empty() || (m_cellStats != 0)) {
+			if (m_imgView || inPlace) m_img = img;
+			else for (const Rect &r : vRects) {
+				Rect rect = r & imgRect;
+				Mat	 dst  = m_img(rect);
+				img(rect).copyTo(dst);
+			}
+			if (!m_cellData.empty()) m_cellData.release();
+			if (!m_cellSum.empty()) m_cellSum.release();
+			if (!m_sparseData.empty()) { m_sparseData.release(); m_sparseMask.release(); }
+			return;
 		}
-		m_imgSize = img.size();
-		if (!m_cellData.empty()) m_cellData.release();
+
+		if (m_cellSpans.empty()) calculate_inverseLUT();
+		const int			 C			= m_img.channels();
+		const int			*pOffsets	= m_cellOffsets.ptr<int>(0);
+		const cell_row_span	*pCellSpans = m_cellSpans.ptr<cell_row_span>(0);
+		std::vector<double>	 vOld(C * m_img.cols), vNew(C * m_img.cols);
+
+		// converts the pixels [x0; x1) of the row y into the buffer
+		auto getPixels = [C](const Mat &img, int y, int x0, int x1, std::vector<double> &vBuf) {
+			Mat dst(1, x1 - x0, CV_MAKE_TYPE(CV_64F, C), vBuf.data());
+			img.row(y).colRange(x0, x1).convertTo(dst, CV_64F);
+		};
+
+		// In the CELL_AVG mode the per-cell sums (calculated together with the cell colors) are updated with the differences of the changed pixels
+		const bool useSums = (m_cellIntApp == CELL_AVG) && !inPlace;
+
+		// Affected cells: the rectangles are processed row by row as disjoint intervals, so the overlapping pixels are counted once
+		std::vector<Rect> vClipped;
+		int				  y0 = img.rows, y1 = 0;
+		for (const Rect &r : vRects) {
+			Rect rect = r & imgRect;
+			if (rect.area() == 0) continue;
+			vClipped.push_back(rect);
+			y0 = MIN(y0, rect.y);
+			y1 = MAX(y1, rect.y + rect.height);
+		}
+
+		std::vector<int>				 vCells;
+		std::vector<std::pair<int, int>> vIntervals;
+		for (int y = y0; y < y1; y++) {
+			vIntervals.clear();
+			for (const Rect &rect : vClipped)
+				if ((y >= rect.y) && (y < rect.y + rect.height)) vIntervals.push_back(std::make_pair(rect.x, rect.x + rect.width));
+			std::sort(vIntervals.begin(), vIntervals.end());
+
+			for (size_t i = 0; i < vIntervals.size(); ) {
+				const int x0 = vIntervals[i].first;
+				int		  x1 = vIntervals[i].second;
+				for (i++; (i < vIntervals.size()) && (vIntervals[i].first <= x1); i++) x1 = MAX(x1, vIntervals[i].second);
+
+				// the pixels [x0; x1) of the row y
+				if (useSums) {
+					getPixels(m_img, y, x0, x1, vOld);
+					getPixels(img,	 y, x0, x1, vNew);
+				}
+				const cell_span *pSpan = findSpan(y, x0);
+				for (; pSpan->x < x1; pSpan++) {
+					const int idx = pSpan->idx;
+					vCells.push_back(idx);
+					if (!useSums) continue;
+					double *pSum = m_cellSum.ptr<double>(0) + C * idx;
+					for (int x = MAX(pSpan->x, x0); x < MIN((pSpan + 1)->x, x1); x++)
+						for (int c = 0; c < C; c++) pSum[c] += vNew[C * (x - x0) + c] - vOld[C * (x - x0) + c];
+				}
+			} // i
+		} // y
+
+		if (!m_imgView && !inPlace)
+			for (const Rect &rect : vClipped) {
+				Mat dst = m_img(rect);
+				img(rect).copyTo(dst);
+			}
+		if (m_imgView || inPlace) m_img = img;
+		std::sort(vCells.begin(), vCells.end());
+		vCells.erase(std::unique(vCells.begin(), vCells.end()), vCells.end());
+
+		// Re-calculation of the affected cells
+		double				*pData = m_cellData.ptr<double>(0);
+		std::vector<double>	 vValues;
+		for (int idx : vCells) {
+			if (useSums) {
+				int nPixels = 0;
+				for (int k = pOffsets[idx]; k < pOffsets[idx + 1]; k++) nPixels += pCellSpans[k].x1 - pCellSpans[k].x0;
+				if (nPixels == 0) continue;
+				const double *pSum = m_cellSum.ptr<double>(0) + C * idx;
+				for (int c = 0; c < C; c++) pData[C * idx + c] = pSum[c] / nPixels;
+			}
+			else calculate_cell(idx, pData + C * idx, m_cellSum.empty() ? NULL : m_cellSum.ptr<double>(0) + C * idx, vValues);
+		} // idx
 	}
 
 	void CCell::setRadius(double R)
@@ -80,16 +220,53 @@ namespace HexagonCells
 		if (R == m_R) return;
 
 		if (!m_LUT.empty()) m_LUT.release();		// release LUT
+		m_pLUT.reset();
 		m_R = R;
 		m_r = 0.5 * sqrt(3.0) * R;
 		m_nCells = -1;
+		if (!m_adjacency.empty()) m_adjacency.release();
+		if (!m_cellSpans.empty()) { m_cellOffsets.release(); m_cellSpans.release(); }
 		if (!m_cellData.empty()) m_cellData.release();
+		if (!m_cellSum.empty()) m_cellSum.release();
+		if (!m_sparseData.empty()) { m_sparseData.release(); m_sparseMask.release(); }
 	}
 
 	void CCell::setInterpolationApproach(cell_int_app cellIntApp)
 	{
 		m_cellIntApp = cellIntApp;
 		if (!m_cellData.empty()) m_cellData.release();
+		if (!m_cellSum.empty()) m_cellSum.release();
+		if (!m_sparseData.empty()) { m_sparseData.release(); m_sparseMask.release(); }
+	}
+
+	void CCell::setPrefixSums(bool enable)
+	{
+		m_usePrefix = enable;
+		if (!enable) releasePrefix();
+	}
+
+	void CCell::setStatistics(int stats)
+	{
+		if (stats == m_cellStats) return;
+		m_cellStats = stats;
+		if (!m_cellData.empty()) m_cellData.release();
+		if (!m_cellSum.empty()) m_cellSum.release();
+		if (!m_sparseData.empty()) { m_sparseData.release(); m_sparseMask.release(); }
+	}
+
+	void CCell::prepare(bool adjacency)
+	{
+		if (m_nCells < 0) calculate_nCells();
+		if (adjacency && m_adjacency.empty()) calculate_adjacency();
+		if (!m_img.empty() && m_cellData.empty()) calculate_cellData();
+	}
+
+	bool CCell::isPrepared(bool adjacency) const
+	{
+		bool res = m_pLUT && (m_nCells >= 0);
+		if (adjacency) res &= !m_adjacency.empty();
+		if (!m_img.empty()) res &= !m_cellData.empty();
+		return res;
 	}
 
 	cell_params CCell::getInfo(void)
@@ -104,49 +281,253 @@ namespace HexagonCells
 		return res;
 	}
 
+	cell_params CCell::getInfo(void) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(m_nCells >= 0, "The number of cells is not calculated (Ref. prepare())");
+
+		cell_params res;
+		res.R = m_R;
+		res.r = m_r;
+		res.S = m_R * (3 * m_r);
+		res.N = m_nCells;
+		return res;
+	}
+
 	int	CCell::getIDX(int x, int y)
 	{
+		if (!m_pLUT) calculate_LUT();
+		return d2idx(cvPoint2D64f(x, y));
+	}
+
+	int	CCell::getIDX(int x, int y) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(m_pLUT, "The look-up table is not calculated (Ref. prepare())");
 		return d2idx(cvPoint2D64f(x, y));
 	}
 
 	int CCell::getNeighbourIDX(int idx, int i)
 	{
-		if (m_nCells < 0) calculate_nCells();
+		if (m_adjacency.empty()) calculate_adjacency();
+
+		// Assertions
+		HCELL_ASSERT_MSG((idx >= 0) && (idx < m_nCells), "The cell index %d is out of range [0; %d)", idx, m_nCells);
+
+		if ((i < 0) || (i > 5)) return -1;
+		return m_adjacency.ptr<int>(idx)[i];
+	}
 
-		double	dx = 2.0 * m_r;
-		double	imgWidth = static_cast<double>(m_imgSize.width);
-		int		width0 = static_cast<int> (0.99 + imgWidth / dx);
-		int		width1 = 1 + static_cast<int> (0.99 + (imgWidth - m_r) / dx);
+	int CCell::getNeighbourIDX(int idx, int i) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(!m_adjacency.empty(), "The adjacency table is not calculated (Ref. prepare())");
+		HCELL_ASSERT_MSG((idx >= 0) && (idx < m_nCells), "The cell index %d is out of range [0; %d)", idx, m_nCells);
+		if ((i < 0) || (i > 5)) return -1;
+		return m_adjacency.ptr<int>(idx)[i];
+	}
 
-		Point c = idx2h(idx, m_R, m_imgSize);
+	int * CCell::getNeighbourhood(int idx)
+	{
+		if (m_adjacency.empty()) calculate_adjacency();
 
-		int d = 0;
-		if ((c.y % 2) == 0) d = 1;
+		// Assertions
+		HCELL_ASSERT_MSG((idx >= 0) && (idx < m_nCells), "The cell index %d is out of range [0; %d)", idx, m_nCells);
 
-		int res = 0;
-		switch (i) {
-		case 0: c.x += 1;            break;
-		case 1: c.x += d;    c.y += 1; break;
-		case 2: c.x += d - 1;  c.y += 1; break;
-		case 3: c.x -= 1;		       break;
-		case 4: c.x += d - 1;  c.y -= 1; break;
-		case 5: c.x += d;    c.y -= 1; break;
-		default: res = -1;		   break;
-		}
-		if ((c.x < 0) || (c.y < 0)) res = -1;
-		if (((c.y % 2) == 0) && (c.x >= width0)) res = -1;
-		if (((c.y % 2) != 0) && (c.x >= width1)) res = -1;
-		if (res == 0) {
-			res = h2idx(c);
-			if (res >= m_nCells) res = -1;
+		int *res = new int[6];
+		memcpy(res, m_adjacency.ptr<int>(idx), 6 * sizeof(int));
+		return res;
+	}
+
+	void CCell::getNeighbourhood(int idx, int *pDst)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(pDst != NULL, "The destination buffer is not set");
+
+		if (m_adjacency.empty()) calculate_adjacency();
+		HCELL_ASSERT_MSG((idx >= 0) && (idx < m_nCells), "The cell index %d is out of range [0; %d)", idx, m_nCells);
+		memcpy(pDst, m_adjacency.ptr<int>(idx), 6 * sizeof(int));
+	}
+
+	Mat CCell::getAdjacency(void)
+	{
+		if (m_adjacency.empty()) calculate_adjacency();
+		return m_adjacency;
+	}
+
+	Mat CCell::getAdjacency(void) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(!m_adjacency.empty(), "The adjacency table is not calculated (Ref. prepare())");
+		return m_adjacency;
+	}
+
+	Mat CCell::getCellSpans(int idx)
+	{
+		if (m_cellSpans.empty()) calculate_inverseLUT();
+
+		// Assertions
+		HCELL_ASSERT_MSG((idx >= 0) && (idx < m_nCells), "The cell index %d is out of range [0; %d)", idx, m_nCells);
+
+		const int *pOffsets = m_cellOffsets.ptr<int>(0);
+		if (pOffsets[idx] == pOffsets[idx + 1]) return Mat();
+		return m_cellSpans.colRange(pOffsets[idx], pOffsets[idx + 1]);
+	}
+
+	void CCell::getInverseLUT(Mat &offsets, Mat &spans)
+	{
+		if (m_cellSpans.empty()) calculate_inverseLUT();
+		offsets = m_cellOffsets;
+		spans	= m_cellSpans;
+	}
+
+	Rect CCell::getBoundingRect(int idx)
+	{
+		if (m_cellSpans.empty()) calculate_inverseLUT();
+
+		// Assertions
+		HCELL_ASSERT_MSG((idx >= 0) && (idx < m_nCells), "The cell index %d is out of range [0; %d)", idx, m_nCells);
+
+		const int			*pOffsets = m_cellOffsets.ptr<int>(0);
+		const cell_row_span	*pSpans	  = m_cellSpans.ptr<cell_row_span>(0);
+		if (pOffsets[idx] == pOffsets[idx + 1]) return Rect();
+
+		// the spans are ordered by the image rows
+		int x0 = pSpans[pOffsets[idx]].x0;
+		int x1 = pSpans[pOffsets[idx]].x1;
+		for (int k = pOffsets[idx] + 1; k < pOffsets[idx + 1]; k++) {
+			x0 = MIN(x0, pSpans[k].x0);
+			x1 = MAX(x1, pSpans[k].x1);
 		}
+		int y0 = pSpans[pOffsets[idx]].y;
+		int y1 = pSpans[pOffsets[idx + 1] - 1].y + 1;
+		return Rect(x0, y0, x1 - x0, y1 - y0);
+	}
+
+	Mat CCell::getComponents(double threshold, int *pNumComponents)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(threshold >= 0, "The color distance threshold must be non-negative");
+
+		if (m_cellData.empty()) calculate_cellData();
+		if (m_adjacency.empty()) calculate_adjacency();
+
+		Mat res;
+		int nComponents = labelComponents(m_cellData, m_adjacency, threshold, res);
+		if (pNumComponents) *pNumComponents = nComponents;
 		return res;
 	}
 
-	int * CCell::getNeighbourhood(int idx)
+	Mat CCell::getDistances(const std::vector<int> &vSources, double weight, Mat *pNearest)
 	{
-		int *res = new int[6];
-		for (int i = 0; i < 6; i++) res[i] = getNeighbourIDX(idx, i);
+		// Assertions
+		HCELL_ASSERT_MSG(weight >= 0, "The weight of the color differences must be non-negative");
+
+		if ((weight > 0) && m_cellData.empty()) calculate_cellData();
+		if (m_adjacency.empty()) calculate_adjacency();
+
+		Mat res(1, m_nCells, CV_64FC1);
+		Mat nearest(1, m_nCells, CV_32SC1);
+		double	*pDist	  = res.ptr<double>(0);
+		int		*pNear	  = nearest.ptr<int>(0);
+		std::fill(pDist, pDist + m_nCells, std::numeric_limits<double>::infinity());
+		std::fill(pNear, pNear + m_nCells, -1);
+		for (int idx : vSources) {
+			HCELL_ASSERT_MSG((idx >= 0) && (idx < m_nCells), "The source cell index %d is out of range", idx);
+			pDist[idx]	  = 0;
+			pNear[idx]	  = idx;
+		}
+
+		const int	  C		= (weight > 0) ? m_cellData.channels() : 0;
+		const double *pData = (weight > 0) ? m_cellData.ptr<double>(0) : NULL;
+
+		// relaxes the cell idx from its neighbours [i0; i0 + 3) and returns true if its distance has changed
+		auto relax = [&](int idx, int i0) {
+			const int *pAdj	   = m_adjacency.ptr<int>(idx);
+			bool	   changed = false;
+			for (int i = i0; i < i0 + 3; i++) {
+				const int n = pAdj[i];
+				if ((n < 0) || (pDist[n] == std::numeric_limits<double>::infinity())) continue;
+				double cost = 1;
+				if (weight > 0) {
+					double dist2 = 0;
+					for (int c = 0; c < C; c++) {
+						double d = pData[C * idx + c] - pData[C * n + c];
+						dist2 += d * d;
+					}
+					cost += weight * sqrt(dist2);
+				}
+				if (pDist[n] + cost < pDist[idx]) {
+					pDist[idx]	  = pDist[n] + cost;
+					pNear[idx]	  = pNear[n];
+					changed		  = true;
+				}
+			}
+			return changed;
+		};
+
+		// The neighbours 3, 4 and 5 precede the cell in the raster order, and the neighbours 0, 1 and 2 follow it
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int idx = 0; idx < m_nCells; idx++)		 changed |= relax(idx, 3);
+			for (int idx = m_nCells - 1; idx >= 0; idx--) changed |= relax(idx, 0);
+		}
+
+		if (pNearest) *pNearest = nearest;
+		return res;
+	}
+
+	Mat CCell::getCellVals(const std::vector<int> &vIdx)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(!m_img.empty(), "The image is not set");
+
+		if (m_nCells < 0) calculate_nCells();
+		const int C = m_img.channels();
+		Mat res(1, MAX(static_cast<int>(vIdx.size()), 1), CV_MAKE_TYPE(CV_64F, C));
+		double *pRes = res.ptr<double>(0);
+
+		// The memoized cells, or all of them, if the cell colors are calculated
+		const double *pData = m_cellData.empty() ? NULL : m_cellData.ptr<double>(0);
+		if (!pData) {
+			if (m_sparseData.empty()) {
+				m_sparseData.create(1, m_nCells, CV_MAKE_TYPE(CV_64F, C));
+				m_sparseMask.create(1, m_nCells, CV_8UC1);
+				m_sparseMask.setTo(0);
+			}
+			pData = m_sparseData.ptr<double>(0);
+		}
+
+		std::vector<double> vValues;
+		for (size_t i = 0; i < vIdx.size(); i++) {
+			const int idx = vIdx[i];
+			HCELL_ASSERT_MSG((idx >= 0) && (idx < m_nCells), "The cell index %d is out of range", idx);
+			if (m_cellData.empty() && !m_sparseMask.at<byte>(0, idx)) {
+				calculate_cell(idx, m_sparseData.ptr<double>(0) + C * idx, NULL, vValues);
+				m_sparseMask.at<byte>(0, idx) = 1;
+			}
+			memcpy(pRes + C * i, pData + C * idx, C * sizeof(double));
+		}
+		return vIdx.empty() ? Mat() : res;
+	}
+
+	Mat CCell::getCellVals(const Rect &roi, std::vector<int> *pvIdx)
+	{
+		if (!m_pLUT) calculate_LUT();
+		const Rect rect = roi & Rect(0, 0, m_imgSize.width, m_imgSize.height);
+
+		// The cells, which intersect the region
+		std::vector<int> vIdx;
+		for (int y = rect.y; y < rect.y + rect.height; y++) {
+			const cell_span *pSpan = findSpan(y, rect.x);
+			for (; pSpan->x < rect.x + rect.width; pSpan++) vIdx.push_back(pSpan->idx);
+		}
+		std::sort(vIdx.begin(), vIdx.end());
+		vIdx.erase(std::unique(vIdx.begin(), vIdx.end()), vIdx.end());
+
+		Mat res = getCellVals(vIdx);
+		if (pvIdx) *pvIdx = vIdx;
 		return res;
 	}
 
@@ -157,77 +538,1161 @@ namespace HexagonCells
 		CvScalar res;
 
 		int C = m_img.channels();
-		for (int c = 0; c < C; c++) res.val[c] = m_cellData.at<double>(0, C * idx + c);
+		for (int c = 0; c < MIN(C, 4); c++) res.val[c] = m_cellData.at<double>(0, C * idx + c);
 
 		return res;
 	}
 
-	// =================== Auxilary functions ==================
-	bool ifInsideTriangle(CvPoint2D64f x, CvPoint2D64f a, CvPoint2D64f b, CvPoint2D64f c)
+	CvScalar CCell::getVal(int idx) const
 	{
-		double r1, r2, r3;
-		r1 = (a.x - x.x) * (b.y - a.y) - (b.x - a.x) * (a.y - x.y);
-		r2 = (b.x - x.x) * (c.y - b.y) - (c.x - b.x) * (b.y - x.y);
-		r3 = (c.x - x.x) * (a.y - c.y) - (a.x - c.x) * (c.y - x.y);
-		if (SIGN(r1) == SIGN(r2) == SIGN(r3)) return true;
-		return false;
+		// Assertions
+		HCELL_ASSERT_MSG(!m_cellData.empty(), "The cell colors are not calculated (Ref. prepare())");
+
+		CvScalar res = cvScalarAll(0);
+
+		int C = m_cellData.channels();
+		const double *pVal = m_cellData.ptr<double>(0) + C * idx;
+		for (int c = 0; c < MIN(C, 4); c++) res.val[c] = pVal[c];
+
+		return res;
 	}
 
-	// =================== Private functions ===================
-	int CCell::calculate_LUT(void)
+	Mat CCell::getVals(void)
+	{
+		if (m_cellData.empty()) calculate_cellData();
+		return m_cellData;
+	}
+
+	Mat CCell::getVals(void) const
 	{
 		// Assertions
-		HCELL_ASSERT_MSG((m_imgSize.height != 0) && (m_imgSize.width != 0), "The image size is not set");
+		HCELL_ASSERT_MSG(!m_cellData.empty(), "The cell colors are not calculated (Ref. prepare())");
+		return m_cellData;
+	}
 
-		if (!m_LUT.empty()) m_LUT.release();
-		m_LUT.create(m_imgSize, CV_32SC1);
+	void CCell::getVals(void *pDst, int depth)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(pDst != NULL, "The destination buffer is not set");
+		HCELL_ASSERT_MSG((depth == CV_8U) || (depth == CV_32F) || (depth == CV_64F), "Unsupported element type: %d", depth);
 
-		double	dx = 2.0 * m_r;			// x - distance between cells
-		double	dy = 1.5 * m_R;			// y - distance between cells
+		if (m_cellData.empty()) calculate_cellData();
+
+		Mat dst(m_cellData.size(), CV_MAKE_TYPE(depth, m_cellData.channels()), pDst);
+		m_cellData.convertTo(dst, depth);
+	}
+
+	void CCell::getVals(Mat &dst)
+	{
+		if (m_cellData.empty()) {
+			// Assertions
+			HCELL_ASSERT_MSG(!m_img.empty(), "The image is not set");
 
-		for (register int y = 0; y < m_LUT.rows; y++) {
-			dword *pLUT = m_LUT.ptr<dword>(y);
-			for (register int x = 0; x < m_LUT.cols; x++) {
-				CvPoint2D64f	X = cvPoint2D64f(x, y);					// X - point in image cartesian <d> coordinate
-				Point			c = d2h(X);								// cell indexes in hexagonical <h> coordinate system 
-
-				// cell center coordinates in image
-				CvPoint2D64f C;
-				C.y = c.y * dy + 0.5 * m_R;
-				C.x = c.x * dx + m_r;
-
-				if ((c.y % 2) == 1) X.x += m_r;
-				bool inside = ifInsideCell(X, C);
-				if (!inside) {
-					if ((c.y % 2) == 0) {
-						if (X.x >= C.x) c.x++;
+			if (m_nCells < 0) calculate_nCells();
+			dst.create(1, m_nCells, CV_MAKE_TYPE(CV_64F, m_img.channels()));
+			m_cellData = dst;							// the colors are calculated directly into the caller's matrix
+			calculate_cellData();
+		}
+		else if (dst.data != m_cellData.data) m_cellData.copyTo(dst);
+	}
+
+	vec_mat_t CCell::getVals(const std::vector<double> &vR)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(!m_img.empty(), "The image is not set");
+
+		// The prefix sums of the image are calculated once for all the radii
+		bool usePrefix = (m_cellIntApp == CELL_AVG) && (m_cellStats == 0);
+		bool anyPrefix = false;
+		for (double R : vR) anyPrefix |= usePrefix && isPrefixExact(m_img.depth(), R);
+		if (anyPrefix && m_prefix.empty()) calculate_prefix();
+
+		vec_mat_t res;
+		res.reserve(vR.size());
+		for (double R : vR) {
+			HCELL_ASSERT_MSG(R >= MIN_RADIUS, "The cell radius is not set or has a wrong value");
+			CCell cell(m_imgSize, R, m_cellIntApp);		// shares the image, the prefix sums and the cached look-up tables
+			cell.m_img		 = m_img;
+			cell.m_usePrefix = usePrefix && isPrefixExact(m_img.depth(), R);
+			cell.m_prefix	 = m_prefix;
+			res.push_back(cell.getVals());
+		}
+
+		if (!m_usePrefix && !m_prefix.empty()) m_prefix.release();
+		return res;
+	}
+
+	Mat CCell::getStat(cell_stat stat)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((m_cellStats & stat) != 0, "The cell statistic %d is not enabled", stat);
+
+		if (m_cellData.empty()) calculate_cellData();
+		switch (stat) {
+			case CELL_STAT_COUNT:	 return m_cellCount;
+			case CELL_STAT_MIN:		 return m_cellMin;
+			case CELL_STAT_MAX:		 return m_cellMax;
+			case CELL_STAT_VAR:		 return m_cellVar;
+			case CELL_STAT_CENTROID: return m_cellCentroid;
+			default:				 return Mat();
+		}
+	}
+
+	int CCell::save(const std::string &fileName, bool adjacency)
+	{
+		if (m_cellData.empty()) calculate_cellData();
+		if (adjacency && m_adjacency.empty()) calculate_adjacency();
+
+		cell_params		 params = getInfo();
+		cell_file_header header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, CELL_FILE_MAGIC, sizeof(header.magic));
+		header.version		= CELL_FILE_VERSION;
+		header.width		= static_cast<dword>(m_imgSize.width);
+		header.height		= static_cast<dword>(m_imgSize.height);
+		header.R			= params.R;
+		header.r			= params.r;
+		header.S			= params.S;
+		header.nCells		= params.N;
+		header.channels		= m_cellData.channels();
+		header.cellIntApp	= static_cast<dword>(m_cellIntApp);
+		header.flags		= adjacency ? CELL_FILE_ADJACENCY : 0;
+		header.valuesOffset = sizeof(header);
+		if (adjacency) header.adjacencyOffset = header.valuesOffset + m_cellData.total() * m_cellData.elemSize();
+
+		FILE *pFile = fopen(fileName.c_str(), "wb");
+		if (pFile == NULL) {
+			HCELL_WARNING("Can not write the cell data to \"%s\"", fileName.c_str());
+			return -1;
+		}
+		bool res = fwrite(&header, sizeof(header), 1, pFile) == 1;
+		res &= fwrite(m_cellData.ptr<double>(0), m_cellData.elemSize(), m_cellData.cols, pFile) == static_cast<size_t>(m_cellData.cols);
+		if (adjacency) res &= fwrite(m_adjacency.ptr<int>(0), 6 * sizeof(int), m_adjacency.rows, pFile) == static_cast<size_t>(m_adjacency.rows);
+		res &= fclose(pFile) == 0;
+		if (!res) {
+			HCELL_WARNING("Can not write the cell data to \"%s\"", fileName.c_str());
+			return -1;
+		}
+		return 0;
+	}
+
+	Mat CCell::getLUT(void)
+	{
+		if (m_LUT.empty()) {
+			if (!m_pLUT) { if (calculate_LUT() != 0) return Mat(); }
+
+			const cell_span	*pSpans	   = m_pLUT->spans.ptr<cell_span>(0);
+			const int		*pRowSpans = m_pLUT->rowSpans.ptr<int>(0);
+			m_LUT.create(m_imgSize, CV_32SC1);
+			for (int y = 0; y < m_LUT.rows; y++) {
+				int *pLUT = m_LUT.ptr<int>(y);
+				for (int k = pRowSpans[y]; k < pRowSpans[y + 1] - 1; k++)
+					for (int x = pSpans[k].x; x < pSpans[k + 1].x; x++) pLUT[x] = pSpans[k].idx;
+			}
+		}
+		return m_LUT;
+	}
+
+	void CCell::setLUT(Mat &LUT)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(LUT.type() == CV_32SC1, "The look-up table must be of type CV_32SC1");
+
+		LUT.copyTo(m_LUT);
+		m_pLUT	 = encodeLUT(m_LUT);
+		m_nCells = m_pLUT->nCells;
+		if (!m_adjacency.empty()) m_adjacency.release();
+		if (!m_cellSpans.empty()) { m_cellOffsets.release(); m_cellSpans.release(); }
+	}
+
+	// =================== Auxilary functions ==================
+	namespace {
+		// Row-invariant part of the look-up table calculation
+		// The cell containment test of the original (per-pixel) builder is evaluated in a closed form: the candidate cell is taken from
+		// the offset <h> coordinates, and the six triangle tests are expanded into cross products, whose y-components depend only on the row.
+		// All the expressions keep the operand order of the triangle tests, thus the resulting indexes are bit-exact with them.
+		typedef struct {
+			double	dx;				// x - distance between cells
+			double	r;				// Hexagon inner radius
+			double	shift;			// x - shift of the pixel for odd cell rows
+			bool	odd;			// true if the candidate cell row is odd
+			int		baseIn;			// index of the first cell in the candidate cell row
+			int		baseOut;		// index of the first cell in the previous cell row
+			double	ey_ab[6];		// B_i.y - C.y
+			double	ey_bc[6];		// B_j.y - B_i.y
+			double	ey_ca[6];		// C.y - B_j.y
+			double	dya;			// C.y - X.y
+			double	dyb[6];			// B_i.y - X.y
+			double	dyc[6];			// B_j.y - X.y
+		} lut_row;
+
+		// Index of the first cell in the cell row y (the same as h2idx(Point(0, y))); the row widths are given by CCell::getRowWidths()
+		inline int getRowBase(int y, int width0, int widthD)
+		{
+			int a = y / 2;
+			int b = y - 2 * a;
+			return a * widthD + ((b == 1) ? width0 : 0);
+		}
+
+		lut_row getLUTRow(int y, double R, int width0, int widthD)
+		{
+			lut_row res;
+			double	r  = 0.5 * sqrt(3.0) * R;	// Hexagon inner radius
+			double	dy = 1.5 * R;				// y - distance between cells
+			int		cy = static_cast<int>((y + 0.5 * R) / dy);
+			double	Cy = cy * dy + 0.5 * R;
+			double	By[6] = { Cy - R, Cy - 0.5 * R, Cy + 0.5 * R, Cy + R, Cy + 0.5 * R, Cy - 0.5 * R };
+
+			res.dx		= 2.0 * r;
+			res.r		= r;
+			res.odd		= (cy % 2) == 1;
+			res.shift	= res.odd ? r : 0;
+			res.baseIn	= getRowBase(cy, width0, widthD);
+			res.baseOut = getRowBase(cy - 1, width0, widthD);
+			res.dya		= Cy - y;
+			for (int i = 0; i < 6; i++) {
+				int j = (i + 1) % 6;
+				res.ey_ab[i] = By[i] - Cy;
+				res.ey_bc[i] = By[j] - By[i];
+				res.ey_ca[i] = Cy - By[j];
+				res.dyb[i]	 = By[i] - y;
+				res.dyc[i]	 = By[j] - y;
+			}
+			return res;
+		}
+
+		// Returns the index of the cell, containing pixel (x, row)
+		inline int getLUTValue(int x, const lut_row &row)
+		{
+			double	X  = static_cast<double>(x);
+			int		cx = static_cast<int>(X / row.dx);
+			double	Cx = cx * row.dx + row.r;
+			double	Bp = Cx + row.r;
+			double	Bm = Cx - row.r;
+			double	Bx[6] = { Cx, Bp, Bp, Cx, Bm, Bm };
+			X += row.shift;
+
+			bool inside = false;
+			for (int i = 0; i < 6; i++) {
+				int j = (i + 1) % 6;
+				double r1 = (Cx - X) * row.ey_ab[i] - (Bx[i] - Cx) * row.dya;
+				double r2 = (Bx[i] - X) * row.ey_bc[i] - (Bx[j] - Bx[i]) * row.dyb[i];
+				double r3 = (Bx[j] - X) * row.ey_ca[i] - (Cx - Bx[j]) * row.dyc[i];
+				inside |= (SIGN(r1) == SIGN(r2)) && (SIGN(r3) == 1);		// the same as SIGN(r1) == SIGN(r2) == SIGN(r3)
+			}
+			if (inside) return row.baseIn + cx;
+			if (row.odd) { if (X < Cx) cx--; }
+			else		 { if (X >= Cx) cx++; }
+			return row.baseOut + cx;
+		}
+
+		// Fills the look-up table row; returns the number of the processed pixels
+		int fillLUTRow_AVX2(int *pLUT, int width, const lut_row &row)
+#ifdef ENABLE_AVX2
+		{
+			const __m256d dx	= _mm256_set1_pd(row.dx);
+			const __m256d r		= _mm256_set1_pd(row.r);
+			const __m256d shift = _mm256_set1_pd(row.shift);
+			const __m256d dya	= _mm256_set1_pd(row.dya);
+			const __m256d zero	= _mm256_setzero_pd();
+			const __m256d base	= _mm256_set1_pd(static_cast<double>(row.baseIn - row.baseOut));
+			const __m256d sign	= _mm256_set1_pd(row.odd ? -1.0 : 1.0);
+			__m256d		  X0	= _mm256_setr_pd(0, 1, 2, 3);
+
+			int x = 0;
+			for (; x + 4 <= width; x += 4) {
+				__m256d cx = _mm256_round_pd(_mm256_div_pd(X0, dx), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+				__m256d Cx = _mm256_add_pd(_mm256_mul_pd(cx, dx), r);
+				__m256d Bp = _mm256_add_pd(Cx, r);
+				__m256d Bm = _mm256_sub_pd(Cx, r);
+				__m256d Bx[6] = { Cx, Bp, Bp, Cx, Bm, Bm };
+				__m256d X  = _mm256_add_pd(X0, shift);
+
+				__m256d inside = zero;
+				for (int i = 0; i < 6; i++) {
+					int j = (i + 1) % 6;
+					__m256d r1 = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(Cx, X), _mm256_set1_pd(row.ey_ab[i])), _mm256_mul_pd(_mm256_sub_pd(Bx[i], Cx), dya));
+					__m256d r2 = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(Bx[i], X), _mm256_set1_pd(row.ey_bc[i])), _mm256_mul_pd(_mm256_sub_pd(Bx[j], Bx[i]), _mm256_set1_pd(row.dyb[i])));
+					__m256d r3 = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(Bx[j], X), _mm256_set1_pd(row.ey_ca[i])), _mm256_mul_pd(_mm256_sub_pd(Cx, Bx[j]), _mm256_set1_pd(row.dyc[i])));
+					__m256d s1 = _mm256_cmp_pd(r1, zero, _CMP_GE_OQ);
+					__m256d s2 = _mm256_cmp_pd(r2, zero, _CMP_GE_OQ);
+					__m256d s3 = _mm256_cmp_pd(r3, zero, _CMP_GE_OQ);
+					inside = _mm256_or_pd(inside, _mm256_andnot_pd(_mm256_xor_pd(s1, s2), s3));
+				}
+
+				// idx = baseOut + cx + (inside ? baseIn - baseOut : +/-[X >= Cx | X < Cx])
+				__m256d adj = _mm256_and_pd(row.odd ? _mm256_cmp_pd(X, Cx, _CMP_LT_OQ) : _mm256_cmp_pd(X, Cx, _CMP_GE_OQ), sign);
+				__m256d res = _mm256_add_pd(cx, _mm256_blendv_pd(adj, base, inside));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(pLUT + x), _mm_add_epi32(_mm256_cvttpd_epi32(res), _mm_set1_epi32(row.baseOut)));
+
+				X0 = _mm256_add_pd(X0, _mm256_set1_pd(4.0));
+			}
+			return x;
+		}
+#else
+		{
+			return 0;
+		}
+#endif
+
+		// Run-length encoding of a row of the dense look-up table: appends the spans of the row, including the terminating one
+		void encodeRow(const int *pLUT, int width, std::vector<cell_span> &vSpans)
+		{
+			for (int x = 0; x < width; ) {
+				cell_span span = { x, pLUT[x] };
+				while ((++x < width) && (pLUT[x] == span.idx));
+				vSpans.push_back(span);
+			}
+			cell_span end = { width, -1 };
+			vSpans.push_back(end);
+		}
+
+		// Concatenates the spans of the tiles of image rows into the span index
+		ptr_lut_t packSpans(const std::vector<std::vector<cell_span>> &vTileSpans, const std::vector<int> &vRowCount)
+		{
+			std::shared_ptr<lut_data> res = std::make_shared<lut_data>();
+
+			const int height = static_cast<int>(vRowCount.size());
+			res->rowSpans.create(1, height + 1, CV_32SC1);
+			int *pRowSpans = res->rowSpans.ptr<int>(0);
+			pRowSpans[0] = 0;
+			for (int y = 0; y < height; y++) pRowSpans[y + 1] = pRowSpans[y] + vRowCount[y];
+
+			res->spans.create(1, pRowSpans[height], CV_32SC2);
+			cell_span *pSpans = res->spans.ptr<cell_span>(0);
+			int maxIdx = -1;
+			for (const std::vector<cell_span> &vSpans : vTileSpans) {
+				for (const cell_span &span : vSpans) maxIdx = MAX(maxIdx, span.idx);
+				if (!vSpans.empty()) memcpy(pSpans, vSpans.data(), vSpans.size() * sizeof(cell_span));
+				pSpans += vSpans.size();
+			}
+			res->nCells = maxIdx + 1;
+			return res;
+		}
+
+		// Parallel look-up table builder (over the tiles of image rows)
+		// Every row is calculated into a buffer and run-length encoded, so the dense table is never stored
+		class CLUTBody : public ParallelLoopBody
+		{
+		public:
+			CLUTBody(CvSize imgSize, double R, int width0, int widthD, std::vector<std::vector<cell_span>> &vTileSpans, std::vector<int> &vRowCount)
+				: m_imgSize(imgSize), m_R(R), m_width0(width0), m_widthD(widthD), m_vTileSpans(vTileSpans), m_vRowCount(vRowCount), m_AVX2(false)
+			{
+#ifdef ENABLE_AVX2
+				m_AVX2 = checkHardwareSupport(CV_CPU_AVX2);
+#endif
+			}
+
+			virtual void operator()(const Range &range) const
+			{
+				const int nTiles = static_cast<int>(m_vTileSpans.size());
+				std::vector<int> vRow(m_imgSize.width);
+				int *pLUT = vRow.data();
+
+				for (int t = range.start; t < range.end; t++) {
+					int y0 = static_cast<int>(static_cast<qword>(m_imgSize.height) * t / nTiles);
+					int y1 = static_cast<int>(static_cast<qword>(m_imgSize.height) * (t + 1) / nTiles);
+					std::vector<cell_span> &vSpans = m_vTileSpans[t];
+					for (int y = y0; y < y1; y++) {
+						lut_row	row = getLUTRow(y, m_R, m_width0, m_widthD);
+						int		x	= m_AVX2 ? fillLUTRow_AVX2(pLUT, m_imgSize.width, row) : 0;
+						for (; x < m_imgSize.width; x++) pLUT[x] = getLUTValue(x, row);
+
+						size_t n = vSpans.size();
+						encodeRow(pLUT, m_imgSize.width, vSpans);
+						m_vRowCount[y] = static_cast<int>(vSpans.size() - n);
+					} // y
+				} // t
+			}
+
+		private:
+			CvSize									 m_imgSize;
+			double									 m_R;
+			int										 m_width0;
+			int										 m_widthD;
+			std::vector<std::vector<cell_span>>		&m_vTileSpans;
+			std::vector<int>						&m_vRowCount;
+			bool									 m_AVX2;
+		};
+
+		// Type of the sums of the pixel values: exact 64-bit integers for the integer images and double for the floating-point ones
+		template <typename T> struct sum_type	{ typedef double			type; };
+		template <> struct sum_type<byte>		{ typedef qword				type; };
+		template <> struct sum_type<word>		{ typedef qword				type; };
+		template <> struct sum_type<schar>		{ typedef __int64			type; };
+		template <> struct sum_type<short>		{ typedef __int64			type; };
+		template <> struct sum_type<int>		{ typedef __int64			type; };
+
+		// Type of the sums of the squared pixel values (32-bit integer squares may overflow 64-bit sums, thus they are summed in double)
+		template <typename T> struct sqsum_type	{ typedef typename sum_type<T>::type	type; };
+		template <> struct sqsum_type<int>		{ typedef double						type; };
+
+		// Type of the per-row prefix sums and of their differences: 32-bit modular sums for the 8- and 16-bit images (every sum of a segment
+		// of a row up to 65536 pixels wide fits into 32 bits, so the difference of two prefix sums over a cell span is exact, Ref.
+		// CCell::isPrefixExact()) and double for the other images
+		template <typename T> struct prefix_type	{ typedef double	type;	typedef double	seg; };
+		template <> struct prefix_type<byte>		{ typedef dword		type;	typedef dword	seg; };
+		template <> struct prefix_type<word>		{ typedef dword		type;	typedef dword	seg; };
+		template <> struct prefix_type<schar>		{ typedef dword		type;	typedef int		seg; };
+		template <> struct prefix_type<short>		{ typedef dword		type;	typedef int		seg; };
+
+		const int STAT_SUM = 0x100;		// Internal statistics flag: sums of the pixel values (needed for the average and the variance)
+
+		// Destination matrices of the cell data (empty if not requested)
+		typedef struct {
+			Mat		mean;			// Mat(1, nCells, CV_64FC(C))
+			Mat		count;			// Mat(1, nCells, CV_32SC1)
+			Mat		min;			// Mat(1, nCells, CV_64FC(C))
+			Mat		max;			// Mat(1, nCells, CV_64FC(C))
+			Mat		var;			// Mat(1, nCells, CV_64FC(C))
+			Mat		centroid;		// Mat(1, nCells, CV_64FC2)
+			Mat		sum;			// Mat(1, nCells, CV_64FC(C))
+		} cell_dst;
+
+		// Per-cell sums of a range of cells; only the arrays, required by the flags, are allocated
+		template <typename T>
+		struct cell_sums {
+			typedef typename sum_type<T>::type		S;
+			typedef typename sqsum_type<T>::type	Q;
+
+			int					first;		// index of the first cell
+			int					flags;		// cell_stat flags | STAT_SUM
+			std::vector<int>	count;		// number of pixels for every cell
+			std::vector<S>		sum;		// sum of the pixel values for every cell and channel
+			std::vector<Q>		sqsum;		// sum of the squared pixel values for every cell and channel
+			std::vector<T>		min;		// minimal pixel value for every cell and channel
+			std::vector<T>		max;		// maximal pixel value for every cell and channel
+			std::vector<qword>	sumX;		// sum of the pixel x-coordinates for every cell
+			std::vector<qword>	sumY;		// sum of the pixel y-coordinates for every cell
+
+			void init(int _first, int nCells, int C, int _flags)
+			{
+				first = _first;
+				flags = _flags;
+				if (flags & CELL_STAT_VAR) flags |= STAT_SUM;
+				const size_t n = static_cast<size_t>(nCells) * C;
+				// the arrays keep their capacity, thus a structure, reused for the same range of cells, does not allocate memory
+				count.assign(nCells, 0);
+				if (flags & STAT_SUM)		   sum.assign(n, 0);											else sum.clear();
+				if (flags & CELL_STAT_VAR)	   sqsum.assign(n, 0);											else sqsum.clear();
+				if (flags & CELL_STAT_MIN)	   min.assign(n, std::numeric_limits<T>::max());				else min.clear();
+				if (flags & CELL_STAT_MAX)	   max.assign(n, std::numeric_limits<T>::lowest());			else max.clear();
+				if (flags & CELL_STAT_CENTROID) { sumX.assign(nCells, 0); sumY.assign(nCells, 0); }		else { sumX.clear(); sumY.clear(); }
+			}
+
+			// Adds the pixels [x0; x1) of the image row y (pRow) to the cell id
+			// For CN > 0 the number of channels is known at compile time, so the channel loops are unrolled and the pixel loop is vectorizable
+			template <int CN>
+			inline void add(int id, const T *pRow, int x0, int x1, int y, int C)
+			{
+				const T *pBegin = pRow + C * x0;
+				const T *pEnd	= pRow + C * x1;
+				const size_t i	= static_cast<size_t>(C) * (id - first);
+				count[id - first] += x1 - x0;
+				if (flags & STAT_SUM)		accumulate<CN>(pBegin, pEnd, C, &sum[i]);
+				if (flags & CELL_STAT_VAR)	accumulateSq<CN>(pBegin, pEnd, C, &sqsum[i]);
+				if (flags & CELL_STAT_MIN)
+					for (const T *pVal = pBegin; pVal < pEnd; pVal += C)
+						for (int c = 0; c < (CN ? CN : C); c++) min[i + c] = MIN(min[i + c], pVal[c]);
+				if (flags & CELL_STAT_MAX)
+					for (const T *pVal = pBegin; pVal < pEnd; pVal += C)
+						for (int c = 0; c < (CN ? CN : C); c++) max[i + c] = MAX(max[i + c], pVal[c]);
+				if (flags & CELL_STAT_CENTROID) {
+					sumX[id - first] += (static_cast<qword>(x0) + x1 - 1) * (x1 - x0) / 2;
+					sumY[id - first] += static_cast<qword>(y) * (x1 - x0);
+				}
+			}
+
+			// Adds the pixels [x0; x1) of an image row to the cell id, using the prefix sums of the row (pPrefix); only the sums are updated
+			template <int CN>
+			inline void addPrefix(int id, const typename prefix_type<T>::type *pPrefix, int x0, int x1, int C)
+			{
+				typedef typename prefix_type<T>::seg seg_t;
+				const size_t i = static_cast<size_t>(C) * (id - first);
+				count[id - first] += x1 - x0;
+				for (int c = 0; c < (CN ? CN : C); c++) sum[i + c] += static_cast<S>(static_cast<seg_t>(pPrefix[C * x1 + c] - pPrefix[C * x0 + c]));
+			}
+
+			// Adds the sums of a range of cells within the range of this structure
+			void merge(const cell_sums &rhs, int C)
+			{
+				const int		n = static_cast<int>(rhs.count.size());
+				const size_t	o = static_cast<size_t>(C) * (rhs.first - first);
+				for (int i = 0; i < n; i++) count[rhs.first - first + i] += rhs.count[i];
+				for (size_t i = 0; i < rhs.sum.size(); i++)   sum[o + i]	+= rhs.sum[i];
+				for (size_t i = 0; i < rhs.sqsum.size(); i++) sqsum[o + i]	+= rhs.sqsum[i];
+				for (size_t i = 0; i < rhs.min.size(); i++)   min[o + i]	 = MIN(min[o + i], rhs.min[i]);
+				for (size_t i = 0; i < rhs.max.size(); i++)   max[o + i]	 = MAX(max[o + i], rhs.max[i]);
+				for (size_t i = 0; i < rhs.sumX.size(); i++) {
+					sumX[rhs.first - first + i] += rhs.sumX[i];
+					sumY[rhs.first - first + i] += rhs.sumY[i];
+				}
+			}
+
+			// Stores the cell data of all the cells into the destination matrices: one division per cell and channel
+			void store(cell_dst &dst, int C) const
+			{
+				const int n = static_cast<int>(count.size());
+				for (int i = 0; i < n; i++) {
+					const int id = first + i;
+					const int N	 = count[i];
+					if (!dst.count.empty()) dst.count.ptr<int>(0)[id] = N;
+					if (N == 0) continue;
+					for (int c = 0; c < C; c++) {
+						const size_t j = static_cast<size_t>(C) * i + c;
+						double mean = (flags & STAT_SUM) ? static_cast<double>(sum[j]) / N : 0;
+						if (!dst.mean.empty()) dst.mean.ptr<double>(0)[C * id + c] = mean;
+						if (!dst.sum.empty())  dst.sum.ptr<double>(0)[C * id + c]  = static_cast<double>(sum[j]);
+						if (!dst.min.empty())  dst.min.ptr<double>(0)[C * id + c]  = min[j];
+						if (!dst.max.empty())  dst.max.ptr<double>(0)[C * id + c]  = max[j];
+						if (!dst.var.empty())  dst.var.ptr<double>(0)[C * id + c]  = MAX(0.0, static_cast<double>(sqsum[j]) / N - mean * mean);
 					}
-					else {
-						if (X.x < C.x) c.x--;
+					if (!dst.centroid.empty()) {
+						dst.centroid.ptr<double>(0)[2 * id]		= static_cast<double>(sumX[i]) / N;
+						dst.centroid.ptr<double>(0)[2 * id + 1] = static_cast<double>(sumY[i]) / N;
 					}
-					c.y--;
+				} // i
+			}
+
+		private:
+			template <int CN>
+			static inline void accumulate(const T *pBegin, const T *pEnd, int C, S *pSum)
+			{
+				if (CN == 0) {
+					for (const T *pVal = pBegin; pVal < pEnd; pVal += C)
+						for (int c = 0; c < C; c++) pSum[c] += pVal[c];
 				}
-				pLUT[x] = h2idx(c);
-			} // x
-		} // y
+				else {
+					S sum[CN ? CN : 1] = { 0 };
+					for (const T *pVal = pBegin; pVal < pEnd; pVal += CN)
+						for (int c = 0; c < CN; c++) sum[c] += pVal[c];
+					for (int c = 0; c < CN; c++) pSum[c] += sum[c];
+				}
+			}
+
+			template <int CN>
+			static inline void accumulateSq(const T *pBegin, const T *pEnd, int C, Q *pSum)
+			{
+				for (const T *pVal = pBegin; pVal < pEnd; pVal += C)
+					for (int c = 0; c < (CN ? CN : C); c++) pSum[c] += static_cast<Q>(pVal[c]) * pVal[c];
+			}
+		};
+
+		// Working buffers of the majority voting of a chunk of bands (Ref. CVoteBody)
+		template <typename T>
+		struct vote_buffers {
+			std::vector<int>	vOffset;		// offset of the pixels of every cell of the band in vValues
+			std::vector<T>		vValues;		// pixel values of the band, grouped by cells
+			CVoter<T>			voter;
+			cell_sums<T>		sums;
+		};
+
+		// Working buffers of the calculation of the cell colors, kept between the images; the base class allows to keep the buffers
+		// of the current image depth behind a pointer of one type
+		struct scratch_base {
+			virtual ~scratch_base(void) {}
+		};
+
+		template <typename T>
+		struct typed_scratch : public scratch_base {
+			std::vector<cell_sums<T>>		vTiles;		// partial sums of the tiles of image rows (Ref. averageCells())
+			cell_sums<T>					sums;		// sums of all the cells
+			std::vector<vote_buffers<T>>	vChunks;	// buffers of the chunks of bands (Ref. voteCells())
+		};
+
+		// Returns the buffers for the depth T, re-creating them if the image depth has changed
+		template <typename T>
+		typed_scratch<T> & getTypedScratch(std::shared_ptr<scratch_base> &pScratch)
+		{
+			typed_scratch<T> *pRes = dynamic_cast<typed_scratch<T> *>(pScratch.get());
+			if (!pRes) {
+				pRes = new typed_scratch<T>();
+				pScratch.reset(pRes);
+			}
+			return *pRes;
+		}
+
+		// Parallel single-pass accumulation of the cell sums (over the tiles of image rows)
+		// Every tile accumulates only the range of cells it touches, so the partial sums of all tiles take about the same memory as the result
+		template <typename T, int CN>
+		class CAccumulateBody : public ParallelLoopBody
+		{
+		public:
+			CAccumulateBody(const Mat &img, const Mat &prefix, const lut_data &lut, int flags, std::vector<cell_sums<T>> &vSums)
+				: m_img(img), m_prefix(prefix), m_lut(lut), m_flags(flags), m_vSums(vSums) {}
+
+			virtual void operator()(const Range &range) const
+			{
+				const int		  C			= CN ? CN : m_img.channels();
+				const int		  nTiles	= static_cast<int>(m_vSums.size());
+				const cell_span	* pSpans	= m_lut.spans.ptr<cell_span>(0);
+				const int		* pRowSpans	= m_lut.rowSpans.ptr<int>(0);
+
+				for (int t = range.start; t < range.end; t++) {
+					int y0 = static_cast<int>(static_cast<qword>(m_img.rows) * t / nTiles);
+					int y1 = static_cast<int>(static_cast<qword>(m_img.rows) * (t + 1) / nTiles);
+
+					// range of cells in the tile
+					int first = INT_MAX;
+					int last  = -1;
+					for (int k = pRowSpans[y0]; k < pRowSpans[y1]; k++)
+						if (pSpans[k].idx >= 0) {
+							first = MIN(first, pSpans[k].idx);
+							last  = MAX(last, pSpans[k].idx);
+						}
+
+					cell_sums<T> &sums = m_vSums[t];
+					sums.init(first, last - first + 1, C, m_flags);
+					for (int y = y0; y < y1; y++) {
+						if (m_prefix.empty()) {
+							const T *pImg = m_img.ptr<T>(y);
+							for (int k = pRowSpans[y]; k < pRowSpans[y + 1] - 1; k++)
+								sums.template add<CN>(pSpans[k].idx, pImg, pSpans[k].x, pSpans[k + 1].x, y, C);
+						}
+						else {
+							const typename prefix_type<T>::type *pPrefix = m_prefix.ptr<typename prefix_type<T>::type>(y);
+							for (int k = pRowSpans[y]; k < pRowSpans[y + 1] - 1; k++)
+								sums.template addPrefix<CN>(pSpans[k].idx, pPrefix, pSpans[k].x, pSpans[k + 1].x, C);
+						}
+					} // y
+				} // t
+			}
+
+		private:
+			const Mat					&m_img;
+			const Mat					&m_prefix;			// per-row prefix sums of the image (empty if the pixels are accumulated)
+			const lut_data				&m_lut;
+			int							 m_flags;
+			std::vector<cell_sums<T>>	&m_vSums;
+		};
+
+		// Average value and statistics of every cell: accumulation and reduction of the partial sums
+		// If the prefix sums of the image are given, the sum of every span is taken from them (only the averages are calculated then)
+		template <typename T, int CN>
+		void averageCells(const Mat &img, const Mat &prefix, const lut_data &lut, int flags, cell_dst &dst, typed_scratch<T> &scratch)
+		{
+			const int C		 = img.channels();
+			const int nTiles = MIN(img.rows, 4 * getNumThreads());
+
+			std::vector<cell_sums<T>> &vSums = scratch.vTiles;
+			vSums.resize(nTiles);
+			parallel_for_(Range(0, nTiles), CAccumulateBody<T, CN>(img, prefix, lut, flags | STAT_SUM, vSums));
+
+			cell_sums<T> &sums = scratch.sums;
+			sums.init(0, lut.nCells, C, flags | STAT_SUM);
+			for (const cell_sums<T> &tile : vSums) sums.merge(tile, C);
+			sums.store(dst, C);
+		}
+
+		template <typename T>
+		void averageCells(const Mat &img, const Mat &prefix, const lut_data &lut, int flags, cell_dst &dst, std::shared_ptr<scratch_base> &pScratch)
+		{
+			typed_scratch<T> &scratch = getTypedScratch<T>(pScratch);
+			switch (img.channels()) {
+				case 1:	 averageCells<T, 1>(img, prefix, lut, flags, dst, scratch); break;
+				case 3:	 averageCells<T, 3>(img, prefix, lut, flags, dst, scratch); break;
+				case 4:	 averageCells<T, 4>(img, prefix, lut, flags, dst, scratch); break;
+				default: averageCells<T, 0>(img, prefix, lut, flags, dst, scratch); break;
+			}
+		}
+
+		// Parallel calculation of the per-row prefix sums of the image (over the rows): element x of the row y is the sum of the pixels [0; x)
+		template <typename T>
+		class CPrefixBody : public ParallelLoopBody
+		{
+		public:
+			typedef typename prefix_type<T>::type P;
+
+			CPrefixBody(const Mat &img, Mat &prefix) : m_img(img), m_prefix(prefix) {}
+
+			virtual void operator()(const Range &range) const
+			{
+				const int C		= m_img.channels();
+				const int width = m_img.cols * C;
+				for (int y = range.start; y < range.end; y++) {
+					const T	*pImg	 = m_img.ptr<T>(y);
+					P		*pPrefix = m_prefix.ptr<P>(y);
+					for (int c = 0; c < C; c++) pPrefix[c] = 0;
+					for (int i = 0; i < width; i++) pPrefix[i + C] = pPrefix[i] + pImg[i];
+				}
+			}
+
+		private:
+			const Mat	&m_img;
+			Mat			&m_prefix;
+		};
+
+		// Parallel majority voting (over the chunks of bands of cells)
+		// The pixels of every cell of a band are gathered in the raster order and the vote of the cell is replayed,
+		// so the working memory is proportional to the number of pixels in the band, and the ties are resolved as in a raster scan of the image.
+		// The cell statistics are accumulated, while the pixels are gathered; every band owns its cells, so no reduction is needed.
+		// Every chunk has its own buffers, which keep their capacity between the images
+		template <typename T, int CN>
+		class CVoteBody : public ParallelLoopBody
+		{
+		public:
+			CVoteBody(const Mat &img, const lut_data &lut, const std::vector<int> &vBands, const std::vector<Range> &vBandRows, int flags, const cell_dst &dst, std::vector<vote_buffers<T>> &vChunks)
+				: m_img(img), m_lut(lut), m_vBands(vBands), m_vBandRows(vBandRows), m_flags(flags), m_dst(dst), m_vChunks(vChunks) {}
+
+			virtual void operator()(const Range &range) const
+			{
+				const int		  C			= CN ? CN : m_img.channels();
+				const int		  nBands	= static_cast<int>(m_vBands.size()) - 1;
+				const int		  nChunks	= static_cast<int>(m_vChunks.size());
+				const cell_span	* pSpans	= m_lut.spans.ptr<cell_span>(0);
+				const int		* pRowSpans	= m_lut.rowSpans.ptr<int>(0);
+				cell_dst		  stats		= m_dst;
+				double			* pData		= stats.mean.ptr<double>(0);
+				stats.mean.release();						// the cell values are the votes, not the averages
+
+				for (int t = range.start; t < range.end; t++) {
+					std::vector<int>	&vOffset = m_vChunks[t].vOffset;
+					std::vector<T>		&vValues = m_vChunks[t].vValues;
+					CVoter<T>			&voter	 = m_vChunks[t].voter;
+					cell_sums<T>		&sums	 = m_vChunks[t].sums;
+
+					for (int b = nBands * t / nChunks; b < nBands * (t + 1) / nChunks; b++) {
+						int first  = m_vBands[b];
+						int nCells = m_vBands[b + 1] - first;
+						if (nCells <= 0) continue;
+
+						// rows of the band
+						const int y0 = m_vBandRows[b].start;
+						const int y1 = m_vBandRows[b].end;
+
+						// gathering the pixels of every cell (the spans are copied as a whole)
+						vOffset.assign(nCells + 1, 0);
+						for (int y = y0; y < y1; y++)
+							for (int k = pRowSpans[y]; k < pRowSpans[y + 1] - 1; k++) {
+								unsigned int id = static_cast<unsigned int>(pSpans[k].idx - first);
+								if (id < static_cast<unsigned int>(nCells)) vOffset[id + 1] += pSpans[k + 1].x - pSpans[k].x;
+							}
+						for (int i = 0; i < nCells; i++) vOffset[i + 1] += vOffset[i];
+						vValues.resize(static_cast<size_t>(vOffset[nCells]) * C);
+						if (m_flags) sums.init(first, nCells, C, m_flags);
+
+						for (int y = y0; y < y1; y++) {
+							const T *pImg = m_img.ptr<T>(y);
+							for (int k = pRowSpans[y]; k < pRowSpans[y + 1] - 1; k++) {
+								unsigned int id = static_cast<unsigned int>(pSpans[k].idx - first);
+								if (id < static_cast<unsigned int>(nCells)) {
+									int len = pSpans[k + 1].x - pSpans[k].x;
+									memcpy(&vValues[static_cast<size_t>(vOffset[id]) * C], pImg + C * pSpans[k].x, static_cast<size_t>(len) * C * sizeof(T));
+									vOffset[id] += len;
+									if (m_flags) sums.template add<CN>(pSpans[k].idx, pImg, pSpans[k].x, pSpans[k + 1].x, y, C);
+								}
+							}
+						}
+						if (m_flags) sums.store(stats, C);
+						for (int i = nCells; i > 0; i--) vOffset[i] = vOffset[i - 1];		// restore the offsets
+						vOffset[0] = 0;
+
+						// voting
+						for (int i = 0; i < nCells; i++) {
+							if (vOffset[i + 1] == vOffset[i]) continue;
+							const T *pBegin = vValues.data() + static_cast<size_t>(vOffset[i]) * C;
+							const T *pEnd	= vValues.data() + static_cast<size_t>(vOffset[i + 1]) * C;
+							for (int c = 0; c < C; c++) pData[C * (first + i) + c] = voter.vote(pBegin + c, pEnd, C);
+						} // i
+					} // b
+				} // t
+			}
+
+		private:
+			const Mat				&m_img;
+			const lut_data			&m_lut;
+			const std::vector<int>	&m_vBands;
+			const std::vector<Range>	&m_vBandRows;
+			int						 m_flags;
+			const cell_dst			&m_dst;
+			std::vector<vote_buffers<T>>	&m_vChunks;
+		};
+
+		template <typename T>
+		void voteCells(const Mat &img, const lut_data &lut, const std::vector<int> &vBands, const std::vector<Range> &vBandRows, int flags, cell_dst &dst, std::shared_ptr<scratch_base> &pScratch)
+		{
+			std::vector<vote_buffers<T>> &vChunks = getTypedScratch<T>(pScratch).vChunks;
+			vChunks.resize(MAX(MIN(static_cast<int>(vBands.size()) - 1, 4 * getNumThreads()), 1));
+
+			const Range range(0, static_cast<int>(vChunks.size()));
+			switch (img.channels()) {
+				case 1:	 parallel_for_(range, CVoteBody<T, 1>(img, lut, vBands, vBandRows, flags, dst, vChunks)); break;
+				case 3:	 parallel_for_(range, CVoteBody<T, 3>(img, lut, vBands, vBandRows, flags, dst, vChunks)); break;
+				case 4:	 parallel_for_(range, CVoteBody<T, 4>(img, lut, vBands, vBandRows, flags, dst, vChunks)); break;
+				default: parallel_for_(range, CVoteBody<T, 0>(img, lut, vBands, vBandRows, flags, dst, vChunks)); break;
+			}
+		}
+
+		// (Re-) allocates the matrix of a cell statistic, if it is enabled, and releases it otherwise
+		// The matrix is reused for the next image, unless it is shared with a result of getStat(), which keeps the previous values
+		void createStat(Mat &stat, bool enabled, int nCells, int type)
+		{
+			if (!enabled || (stat.u && (stat.u->refcount > 1))) stat.release();
+			if (enabled) {
+				stat.create(1, nCells, type);
+				stat.setTo(0);
+			}
+		}
+
+		// Parallel calculation of the adjacency table (over the cells)
+		class CAdjacencyBody : public ParallelLoopBody
+		{
+		public:
+			CAdjacencyBody(Mat &adjacency, int width0, int width1) : m_adjacency(adjacency), m_width0(width0), m_width1(width1) {}
+
+			virtual void operator()(const Range &range) const
+			{
+				const int widthD = m_width0 + m_width1;
+				const int nCells = m_adjacency.rows;
+
+				for (int idx = range.start; idx < range.end; idx++) {
+					int *pAdj = m_adjacency.ptr<int>(idx);
+
+					// hexagonal coordinates of the cell (the same as idx2h())
+					Point c;
+					c.y = idx / widthD;
+					c.x = idx - c.y * widthD;
+					c.y *= 2;
+					if (c.x >= m_width0) {
+						c.y++;
+						c.x -= m_width0;
+					}
+					int d = ((c.y % 2) == 0) ? 1 : 0;
+
+					for (int i = 0; i < 6; i++) {
+						Point n = c;
+						switch (i) {
+						case 0: n.x += 1;				 break;
+						case 1: n.x += d;	  n.y += 1; break;
+						case 2: n.x += d - 1; n.y += 1; break;
+						case 3: n.x -= 1;				 break;
+						case 4: n.x += d - 1; n.y -= 1; break;
+						case 5: n.x += d;	  n.y -= 1; break;
+						}
+						int res = 0;
+						if ((n.x < 0) || (n.y < 0)) res = -1;
+						if (((n.y % 2) == 0) && (n.x >= m_width0)) res = -1;
+						if (((n.y % 2) != 0) && (n.x >= m_width1)) res = -1;
+						if (res == 0) {
+							res = getRowBase(n.y, m_width0, widthD) + n.x;		// the same as h2idx()
+							if (res >= nCells) res = -1;
+						}
+						pAdj[i] = res;
+					} // i
+				} // idx
+			}
+
+		private:
+			Mat	&m_adjacency;
+			int	 m_width0;
+			int	 m_width1;
+		};
+
+		// Root of the union-find tree with path halving
+		inline int findRoot(int *pParent, int idx)
+		{
+			while (pParent[idx] != idx) {
+				pParent[idx] = pParent[pParent[idx]];
+				idx = pParent[idx];
+			}
+			return idx;
+		}
+
+		// Union of two union-find trees: the smaller root becomes the root of the union, thus every parent has a smaller index than its child
+		inline void unite(int *pParent, int a, int b)
+		{
+			a = findRoot(pParent, a);
+			b = findRoot(pParent, b);
+			if (a < b)		pParent[b] = a;
+			else if (b < a) pParent[a] = b;
+		}
+
+		// Parallel union-find over the blocks of cells
+		// Every cell is connected to its neighbours 0, 1 and 2, which have greater indexes, thus every edge is visited once. The trees of a block
+		// contain only its own cells; the edges to the next blocks are collected and merged afterwards
+		class CComponentsBody : public ParallelLoopBody
+		{
+		public:
+			CComponentsBody(const Mat &cellData, const Mat &adjacency, double threshold, Mat &parent, int blockSize, std::vector<std::vector<std::pair<int, int>>> &vvEdges)
+				: m_cellData(cellData), m_adjacency(adjacency), m_threshold2(threshold * threshold), m_parent(parent), m_blockSize(blockSize), m_vvEdges(vvEdges) {}
+
+			virtual void operator()(const Range &range) const
+			{
+				const int		 C		 = m_cellData.channels();
+				const int		 nCells	 = m_adjacency.rows;
+				const double	*pData	 = m_cellData.ptr<double>(0);
+				int				*pParent = m_parent.ptr<int>(0);
+
+				for (int b = range.start; b < range.end; b++) {
+					const int start = b * m_blockSize;
+					const int end	= MIN(start + m_blockSize, nCells);
+					std::vector<std::pair<int, int>> &vEdges = m_vvEdges[b];
+
+					for (int idx = start; idx < end; idx++) pParent[idx] = idx;
+					for (int idx = start; idx < end; idx++) {
+						const int *pAdj = m_adjacency.ptr<int>(idx);
+						for (int i = 0; i < 3; i++) {
+							const int n = pAdj[i];
+							if (n < 0) continue;
+
+							double dist2 = 0;
+							for (int c = 0; c < C; c++) {
+								double d = pData[C * idx + c] - pData[C * n + c];
+								dist2 += d * d;
+							}
+							if (dist2 > m_threshold2) continue;
+
+							if (n < end) unite(pParent, idx, n);
+							else		 vEdges.push_back(std::make_pair(idx, n));
+						} // i
+					} // idx
+				} // b
+			}
+
+
+		private:
+			const Mat										&m_cellData;
+			const Mat										&m_adjacency;
+			double											 m_threshold2;
+			Mat												&m_parent;
+			int												 m_blockSize;
+			std::vector<std::vector<std::pair<int, int>>>	&m_vvEdges;
+		};
+	}
+
+	// =================== Private functions ===================
+	struct CCell::scratch_data {
+		std::shared_ptr<scratch_base>	pTyped;			// Buffers of the accumulation and of the voting for the current image depth
+		Mat								prefix;			// Buffer of the prefix sums of the previous image (Ref. releasePrefix())
+		ptr_lut_t						pBandsLUT;		// Look-up table, for which the bands of the voting are calculated
+		std::vector<int>				vBands;			// First cell of every band of the voting (one row of cells)
+		std::vector<Range>				vBandRows;		// Image rows of every band of the voting
+	};
+
+	void CCell::setImageSize(CvSize imgSize)
+	{
+		if ((m_imgSize.width != imgSize.width) || (m_imgSize.height != imgSize.height)) {			// if new size
+			if (!m_LUT.empty()) m_LUT.release();													// release LUT
+			m_pLUT.reset();
+			m_nCells = -1;																			// reset nCells;
+			if (!m_adjacency.empty()) m_adjacency.release();										// release adjacency table
+			if (!m_cellSpans.empty()) { m_cellOffsets.release(); m_cellSpans.release(); }				// release inverse LUT
+		}
+		m_imgSize = imgSize;
+		releasePrefix();
+		if (!m_cellData.empty()) m_cellData.release();				// m_cellSum keeps its buffer, it is re-calculated together with m_cellData
+		if (!m_sparseData.empty()) { m_sparseData.release(); m_sparseMask.release(); }
+	}
+
+	void CCell::releaseStats(void)
+	{
+		m_cellCount.release();
+		m_cellMin.release();
+		m_cellMax.release();
+		m_cellVar.release();
+		m_cellCentroid.release();
+	}
+
+	void CCell::releasePrefix(void)
+	{
+		// only the accelerated mode keeps the buffer between the images
+		if (m_usePrefix) { if (!m_prefix.empty()) getScratch().prefix = m_prefix; }
+		else if (m_pScratch) m_pScratch->prefix.release();
+		m_prefix.release();
+	}
+
+	CCell::scratch_data & CCell::getScratch(void)
+	{
+		if (!m_pScratch) m_pScratch = std::make_shared<scratch_data>();
+		return *m_pScratch;
+	}
+
+	int CCell::calculate_LUT(void)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((m_imgSize.height != 0) && (m_imgSize.width != 0), "The image size is not set");
+
+		m_pLUT	 = CLUTCache::getInstance().get(m_imgSize, m_R);
+		m_nCells = m_pLUT->nCells;
 		return 0;
 	}
 
+	void CCell::getRowWidths(CvSize imgSize, double R, int &width0, int &width1)
+	{
+		double	r = 0.5 * sqrt(3.0) * R;
+		double	dx = 2.0 * r;
+		double	imgWidth = static_cast<double>(imgSize.width);
+		width0 = static_cast<int> (0.99 + imgWidth / dx);
+		width1 = 1 + static_cast<int> (0.99 + (imgWidth - r) / dx);
+	}
+
+	ptr_lut_t CCell::buildLUT(CvSize imgSize, double R)
+	{
+		int		width0, width1;
+		getRowWidths(imgSize, R, width0, width1);
+		int		nTiles = MIN(imgSize.height, 4 * getNumThreads());
+
+		std::vector<std::vector<cell_span>>	vTileSpans(nTiles);
+		std::vector<int>					vRowCount(imgSize.height);
+		parallel_for_(Range(0, nTiles), CLUTBody(imgSize, R, width0, width0 + width1, vTileSpans, vRowCount));
+		return packSpans(vTileSpans, vRowCount);
+	}
+
+	void CCell::calculateLUTRow(CvSize imgSize, double R, int y, int *pLUT)
+	{
+		int		width0, width1;
+		getRowWidths(imgSize, R, width0, width1);
+
+		lut_row	row = getLUTRow(y, R, width0, width0 + width1);
+		int		x	= 0;
+#ifdef ENABLE_AVX2
+		if (checkHardwareSupport(CV_CPU_AVX2)) x = fillLUTRow_AVX2(pLUT, imgSize.width, row);
+#endif
+		for (; x < imgSize.width; x++) pLUT[x] = getLUTValue(x, row);
+	}
+
+	int CCell::getMinIDX(CvSize imgSize, double R, int y)
+	{
+		double	dy = 1.5 * R;
+		int		width0, width1;
+		getRowWidths(imgSize, R, width0, width1);
+
+		// the pixels of the row y belong either to the candidate cell row or to the previous one (Ref. getLUTValue()),
+		// and the candidate cell row does not decrease with y
+		int cy = static_cast<int>((y + 0.5 * R) / dy);
+		return getRowBase(MAX(cy - 1, 0), width0, width0 + width1);
+	}
+
+	ptr_lut_t CCell::encodeLUT(const Mat &LUT)
+	{
+		std::vector<std::vector<cell_span>>	vTileSpans(1);
+		std::vector<int>					vRowCount(LUT.rows);
+		for (int y = 0; y < LUT.rows; y++) {
+			size_t n = vTileSpans[0].size();
+			encodeRow(LUT.ptr<int>(y), LUT.cols, vTileSpans[0]);
+			vRowCount[y] = static_cast<int>(vTileSpans[0].size() - n);
+		}
+		return packSpans(vTileSpans, vRowCount);
+	}
+
 	int CCell::calculate_nCells(void)
 	{
 		// Assertions
 		HCELL_ASSERT_MSG(((m_R >= 0) && (m_r >= 0)), "The cell radius is not set or has a wrong value");
 
 		int res;
-		if (m_LUT.empty())	if ((res = calculate_LUT()) < 0)	return res;
+		if (!m_pLUT)	if ((res = calculate_LUT()) < 0)	return res;
+		m_nCells = m_pLUT->nCells;
 
-		double maxVal;
-		minMaxLoc(m_LUT, NULL, &maxVal, NULL, NULL);
-		m_nCells = static_cast<int>(maxVal) + 1;
+		return 0;
+	}
+
+	int CCell::calculate_adjacency(void)
+	{
+		if (m_nCells < 0) calculate_nCells();
 
+		int		width0, width1;
+		getRowWidths(m_imgSize, m_R, width0, width1);
+
+		m_adjacency.create(m_nCells, 6, CV_32SC1);
+		parallel_for_(Range(0, m_nCells), CAdjacencyBody(m_adjacency, width0, width1));
+		return 0;
+	}
+
+	int CCell::calculate_inverseLUT(void)
+	{
+		if (m_nCells < 0) calculate_nCells();
+
+		const int		 height	   = m_pLUT->rowSpans.cols - 1;
+		const cell_span	*pSpans	   = m_pLUT->spans.ptr<cell_span>(0);
+		const int		*pRowSpans = m_pLUT->rowSpans.ptr<int>(0);
+
+		// Counting the spans of every cell
+		m_cellOffsets.create(1, m_nCells + 1, CV_32SC1);
+		int *pOffsets = m_cellOffsets.ptr<int>(0);
+		std::fill(pOffsets, pOffsets + m_nCells + 1, 0);
+		for (int k = 0; k < pRowSpans[height]; k++)
+			if (pSpans[k].idx >= 0) pOffsets[pSpans[k].idx + 1]++;
+		for (int idx = 0; idx < m_nCells; idx++) pOffsets[idx + 1] += pOffsets[idx];
+
+		// Scattering the spans in the order of the image rows
+		m_cellSpans.create(1, MAX(pOffsets[m_nCells], 1), CV_32SC3);
+		cell_row_span	 *pCellSpans = m_cellSpans.ptr<cell_row_span>(0);
+		std::vector<int>  vPos(pOffsets, pOffsets + m_nCells);
+		for (int y = 0; y < height; y++)
+			for (int k = pRowSpans[y]; k < pRowSpans[y + 1] - 1; k++) {
+				if (pSpans[k].idx < 0) continue;
+				cell_row_span &span = pCellSpans[vPos[pSpans[k].idx]++];
+				span.y	= y;
+				span.x0 = pSpans[k].x;
+				span.x1 = pSpans[k + 1].x;
+			}
 		return 0;
 	}
 
+	int CCell::labelComponents(const Mat &cellData, const Mat &adjacency, double threshold, Mat &labels)
+	{
+		const int nCells	= adjacency.rows;
+		const int nBlocks	= MAX(1, MIN(nCells, 4 * getNumThreads()));
+		const int blockSize = (nCells + nBlocks - 1) / nBlocks;
+
+		labels.create(1, nCells, CV_32SC1);
+		std::vector<std::vector<std::pair<int, int>>> vvEdges(nBlocks);
+		parallel_for_(Range(0, nBlocks), CComponentsBody(cellData, adjacency, threshold, labels, blockSize, vvEdges));
+
+		// Merging the trees of the blocks
+		int *pParent = labels.ptr<int>(0);
+		for (const std::vector<std::pair<int, int>> &vEdges : vvEdges)
+			for (const std::pair<int, int> &edge : vEdges) unite(pParent, edge.first, edge.second);
+
+		// Labeling: every parent precedes its children, thus it is already relabeled, when a child is reached
+		int res = 0;
+		for (int idx = 0; idx < nCells; idx++)
+			pParent[idx] = (pParent[idx] == idx) ? res++ : pParent[pParent[idx]];
+		return res;
+	}
+
+	int CCell::calculate_cell(int idx, double *pVal, double *pSum, std::vector<double> &vValues)
+	{
+		const int C = m_img.channels();
+
+		// A pixel belongs either to its candidate cell or to a neighbour of it in the previous cell row (Ref. getLUTValue()), thus the pixels of
+		// the cell lie in the rows, whose candidate cell row is the cell row or the next one, and within two cells to the left and to the right
+		CvPoint2D64f centre = idx2d(idx, m_R, m_imgSize);
+		const int	 y0		= MAX(0, static_cast<int>(centre.y - m_R) - 1);
+		const int	 y1		= MIN(m_imgSize.height, static_cast<int>(centre.y + 2 * m_R) + 2);
+		const int	 x0		= MAX(0, static_cast<int>(centre.x - 4 * m_r) - 1);
+		const int	 x1		= MIN(m_imgSize.width, static_cast<int>(centre.x + 4 * m_r) + 2);
+
+		// the pixels of the cell in the raster order
+		vValues.clear();
+		for (int y = y0; y < y1; y++) {
+			const cell_span *pSpan = findSpan(y, x0);
+			for (; pSpan->x < x1; pSpan++) {
+				if (pSpan->idx != idx) continue;
+				const size_t n = vValues.size();
+				vValues.resize(n + C * ((pSpan + 1)->x - pSpan->x));
+				Mat dst(1, (pSpan + 1)->x - pSpan->x, CV_MAKE_TYPE(CV_64F, C), vValues.data() + n);
+				m_img.row(y).colRange(pSpan->x, (pSpan + 1)->x).convertTo(dst, CV_64F);
+			}
+		} // y
+
+		const int nPixels = static_cast<int>(vValues.size()) / C;
+		if (m_cellIntApp == CELL_MV) {
+			CVoter<double> voter;
+			for (int c = 0; c < C; c++) pVal[c] = (nPixels > 0) ? voter.vote(vValues.data() + c, vValues.data() + vValues.size(), C) : 0;
+		}
+		else {
+			for (int c = 0; c < C; c++) {
+				double sum = 0;
+				for (size_t i = c; i < vValues.size(); i += C) sum += vValues[i];
+				pVal[c] = (nPixels > 0) ? sum / nPixels : 0;
+				if (pSum) pSum[c] = sum;
+			}
+		}
+		return nPixels;
+	}
+
 	int CCell::calculate_cellData(void)
 	{
 		// Assertions
@@ -236,61 +1701,124 @@ namespace HexagonCells
 		int				C = m_img.channels();
 
 		if (m_nCells < 0) calculate_nCells();
-		if (m_cellData.empty()) {
-			m_cellData.create(1, m_nCells, CV_MAKE_TYPE(CV_64F, C));
-			m_cellData.setTo(0);
-		}
-
-		double	* pData = m_cellData.ptr<double>(0);
-		int		* pNumVal = NULL;
-		int		* pMaxVal = NULL;
-		int		  len = m_nCells;
-
-		if (m_cellIntApp == CELL_MV) len *= 256;
-		pNumVal = new int[len];
-		if (m_cellIntApp == CELL_MV)  pMaxVal = new int[m_nCells];
-
-		for (int c = 0; c < C; c++) {
-			memset(pNumVal, 0, len * sizeof(int));
-			if (pMaxVal != NULL) memset(pMaxVal, 0, m_nCells * sizeof(int));
-			for (register int y = 0; y < m_img.rows; y++) {
-				byte *pImg = m_img.ptr<byte>(y);
-				for (register int x = 0; x < m_img.cols; x++) {
-					int id = d2idx(cvPoint2D64f(x, y));
-					byte val = pImg[C*x + c];
-
-					if (pMaxVal != NULL) {
-						pNumVal[256 * id + val]++;
-						if (pNumVal[256 * id + val] > pMaxVal[id]) {
-							pMaxVal[id]++;
-							pData[C*id + c] = val;
-						}
-					}
-					else {
-						pData[C*id + c] = (pNumVal[id] * pData[C*id + c] + val) / (pNumVal[id] + 1);
-						pNumVal[id]++;
-					}
+		if (m_cellData.empty()) m_cellData.create(1, m_nCells, CV_MAKE_TYPE(CV_64F, C));
+		m_cellData.setTo(0);											// the empty cells are not written
+		createStat(m_cellCount,	   (m_cellStats & CELL_STAT_COUNT) != 0,	m_nCells, CV_32SC1);
+		createStat(m_cellMin,	   (m_cellStats & CELL_STAT_MIN) != 0,		m_nCells, CV_MAKE_TYPE(CV_64F, C));
+		createStat(m_cellMax,	   (m_cellStats & CELL_STAT_MAX) != 0,		m_nCells, CV_MAKE_TYPE(CV_64F, C));
+		createStat(m_cellVar,	   (m_cellStats & CELL_STAT_VAR) != 0,		m_nCells, CV_MAKE_TYPE(CV_64F, C));
+		createStat(m_cellCentroid, (m_cellStats & CELL_STAT_CENTROID) != 0, m_nCells, CV_64FC2);
+
+		return (m_cellIntApp == CELL_MV) ? calculate_cellData_MV() : calculate_cellData_AVG();
+	}
 
-				} // x
-			} // y
-		} // c	
+	int CCell::calculate_cellData_AVG(void)
+	{
+		bool usePrefix = m_usePrefix && (m_cellStats == 0) && isPrefixExact(m_img.depth(), m_R);	// the statistics need the pixels
+		if (usePrefix && m_prefix.empty()) calculate_prefix();
+		Mat prefix = usePrefix ? m_prefix : Mat();
+
+		// the exact sums of the cells are kept for the incremental updates (Ref. updateImage())
+		m_cellSum.create(1, m_nCells, m_cellData.type());
+		m_cellSum.setTo(0);												// the empty cells are not written
+
+		std::shared_ptr<scratch_base> &pTyped = getScratch().pTyped;
+		cell_dst dst = { m_cellData, m_cellCount, m_cellMin, m_cellMax, m_cellVar, m_cellCentroid, m_cellSum };
+		switch (m_img.depth()) {
+			case CV_8U:	 averageCells<byte>(m_img, prefix, *m_pLUT, m_cellStats, dst, pTyped);	break;
+			case CV_8S:	 averageCells<schar>(m_img, prefix, *m_pLUT, m_cellStats, dst, pTyped);	break;
+			case CV_16U: averageCells<word>(m_img, prefix, *m_pLUT, m_cellStats, dst, pTyped);	break;
+			case CV_16S: averageCells<short>(m_img, prefix, *m_pLUT, m_cellStats, dst, pTyped);	break;
+			case CV_32S: averageCells<int>(m_img, prefix, *m_pLUT, m_cellStats, dst, pTyped);		break;
+			case CV_32F: averageCells<float>(m_img, prefix, *m_pLUT, m_cellStats, dst, pTyped);	break;
+			case CV_64F: averageCells<double>(m_img, prefix, *m_pLUT, m_cellStats, dst, pTyped);	break;
+			default:	 HCELL_ASSERT_MSG(false, "Unsupported image depth: %d", m_img.depth());
+		}
+		return 0;
+	}
 
+	bool CCell::isPrefixExact(int depth, double R)
+	{
+		// a cell span is at most 2r + 1 pixels long
+		return (depth > CV_16S) || (sqrt(3.0) * R + 2 <= 65536);
+	}
 
-		delete[] pNumVal;
-		if (pMaxVal != NULL) delete[] pMaxVal;
+	int CCell::calculate_prefix(void)
+	{
+		const int C = m_img.channels();
+		if (m_pScratch) m_prefix = m_pScratch->prefix;					// the buffer of the previous image
+		m_prefix.create(m_img.rows, m_img.cols + 1, (m_img.depth() <= CV_16S) ? CV_32SC(C) : CV_64FC(C));
+		if (m_pScratch) m_pScratch->prefix.release();
+
+		const Range range(0, m_img.rows);
+		switch (m_img.depth()) {
+			case CV_8U:	 parallel_for_(range, CPrefixBody<byte>(m_img, m_prefix));		break;
+			case CV_8S:	 parallel_for_(range, CPrefixBody<schar>(m_img, m_prefix));		break;
+			case CV_16U: parallel_for_(range, CPrefixBody<word>(m_img, m_prefix));		break;
+			case CV_16S: parallel_for_(range, CPrefixBody<short>(m_img, m_prefix));		break;
+			case CV_32S: parallel_for_(range, CPrefixBody<int>(m_img, m_prefix));		break;
+			case CV_32F: parallel_for_(range, CPrefixBody<float>(m_img, m_prefix));		break;
+			case CV_64F: parallel_for_(range, CPrefixBody<double>(m_img, m_prefix));	break;
+			default:	 HCELL_ASSERT_MSG(false, "Unsupported image depth: %d", m_img.depth());
+		}
 		return 0;
-
 	}
 
-	bool CCell::ifInsideCell(CvPoint2D64f x, CvPoint2D64f C) const
+	int CCell::calculate_cellData_MV(void)
 	{
-		bool res;
-		for (int i = 0; i < 6; i++) {
-			int j = (i + 1) % 6;
-			res = ifInsideTriangle(x, C, getBoundaryPoint(C, i, m_R), getBoundaryPoint(C, j, m_R));
-			if (res) break;
+		int		width0, width1;
+		getRowWidths(m_imgSize, m_R, width0, width1);
+
+		// The bands depend only on the grid, thus they are calculated once for the look-up table
+		scratch_data		&scratch   = getScratch();
+		std::vector<int>	&vBands	   = scratch.vBands;
+		std::vector<Range>	&vBandRows = scratch.vBandRows;
+		if (scratch.pBandsLUT != m_pLUT) {
+			// Range of cells in every image row
+			const cell_span	* pSpans	= m_pLUT->spans.ptr<cell_span>(0);
+			const int		* pRowSpans	= m_pLUT->rowSpans.ptr<int>(0);
+			std::vector<int> vRowMin(m_img.rows, INT_MAX), vRowMax(m_img.rows, -1);
+			for (int y = 0; y < m_img.rows; y++)
+				for (int k = pRowSpans[y]; k < pRowSpans[y + 1] - 1; k++) {
+					vRowMin[y] = MIN(vRowMin[y], pSpans[k].idx);
+					vRowMax[y] = MAX(vRowMax[y], pSpans[k].idx);
+				}
+
+			// Every band consists of one row of cells
+			vBands.clear();
+			for (int cy = 0; ; cy++) {
+				int first = getRowBase(cy, width0, width0 + width1);
+				if (first >= m_nCells) { vBands.push_back(m_nCells); break; }
+				vBands.push_back(first);
+			}
+
+			// Image rows of every band: from the first row, which reaches the band, till the last row, which has a cell before its end
+			// (the bound of the rows is monotonic in the band, thus all the bands are processed in two linear passes)
+			const int nBands = static_cast<int>(vBands.size()) - 1;
+			vBandRows.resize(nBands);
+			for (int b = 0, y0 = 0; b < nBands; b++) {
+				while ((y0 < m_img.rows) && (vRowMax[y0] < vBands[b])) y0++;
+				vBandRows[b].start = y0;
+			}
+			for (int b = nBands - 1, y1 = m_img.rows; b >= 0; b--) {
+				while ((y1 > 0) && (vRowMin[y1 - 1] >= vBands[b + 1])) y1--;
+				vBandRows[b].end = MAX(y1, vBandRows[b].start);
+			}
+			scratch.pBandsLUT = m_pLUT;
 		}
-		return res;
+
+		cell_dst dst = { m_cellData, m_cellCount, m_cellMin, m_cellMax, m_cellVar, m_cellCentroid };
+		switch (m_img.depth()) {
+			case CV_8U:	 voteCells<byte>(m_img, *m_pLUT, vBands, vBandRows, m_cellStats, dst, scratch.pTyped);		break;
+			case CV_8S:	 voteCells<schar>(m_img, *m_pLUT, vBands, vBandRows, m_cellStats, dst, scratch.pTyped);	break;
+			case CV_16U: voteCells<word>(m_img, *m_pLUT, vBands, vBandRows, m_cellStats, dst, scratch.pTyped);		break;
+			case CV_16S: voteCells<short>(m_img, *m_pLUT, vBands, vBandRows, m_cellStats, dst, scratch.pTyped);	break;
+			case CV_32S: voteCells<int>(m_img, *m_pLUT, vBands, vBandRows, m_cellStats, dst, scratch.pTyped);		break;
+			case CV_32F: voteCells<float>(m_img, *m_pLUT, vBands, vBandRows, m_cellStats, dst, scratch.pTyped);	break;
+			case CV_64F: voteCells<double>(m_img, *m_pLUT, vBands, vBandRows, m_cellStats, dst, scratch.pTyped);	break;
+			default:	 HCELL_ASSERT_MSG(false, "Unsupported image depth: %d", m_img.depth());
+		}
+		return 0;
 	}
 
 	CvPoint2D64f CCell::getBoundaryPoint(CvPoint2D64f C, int i, double R)
@@ -309,11 +1837,8 @@ namespace HexagonCells
 
 	Point CCell::idx2h(int idx, double R, CvSize imgSize)
 	{
-		double	r = 0.5 * sqrt(3.0) * R;
-		double	dx = 2.0 * r;
-		double	imgWidth = static_cast<double>(imgSize.width);
-		int		width0 = static_cast<int> (0.99 + imgWidth / dx);
-		int		width1 = 1 + static_cast<int> (0.99 + (imgWidth - r) / dx);
+		int		width0, width1;
+		getRowWidths(imgSize, R, width0, width1);
 		int		widthD = width0 + width1;
 
 		// cell indexes
@@ -330,10 +1855,8 @@ namespace HexagonCells
 
 	int CCell::h2idx(Point c) const
 	{
-		double	dx = 2.0 * m_r;
-		double	imgWidth = static_cast<double>(m_imgSize.width);
-		int		width0 = static_cast<int> (0.99 + imgWidth / dx);
-		int		width1 = 1 + static_cast<int> (0.99 + (imgWidth - m_r) / dx);
+		int		width0, width1;
+		getRowWidths(m_imgSize, m_R, width0, width1);
 		int		widthD = width0 + width1;
 
 		// index
@@ -365,9 +1888,24 @@ namespace HexagonCells
 		return res;
 	}
 
-	int	CCell::d2idx(CvPoint2D64f C) {
-		if (m_LUT.empty()) { if (calculate_LUT() != 0) return -1; }
-		return m_LUT.at<int>(static_cast<int>(C.y), static_cast<int>(C.x));
+	int	CCell::d2idx(CvPoint2D64f C) const
+	{
+		int x = static_cast<int>(C.x);
+		int y = static_cast<int>(C.y);
+
+		// Assertions
+		HCELL_ASSERT_MSG((x >= 0) && (x < m_imgSize.width) && (y >= 0) && (y < m_imgSize.height), "The pixel (%d, %d) is out of the image %d x %d", x, y, m_imgSize.width, m_imgSize.height);
+		return findSpan(y, x)->idx;
+	}
+
+	const cell_span * CCell::findSpan(int y, int x) const
+	{
+		// binary search for the last span of the row, which starts not after x
+		const cell_span	*pSpans	   = m_pLUT->spans.ptr<cell_span>(0);
+		const int		*pRowSpans = m_pLUT->rowSpans.ptr<int>(0);
+		const cell_span	*pSpan	   = std::upper_bound(pSpans + pRowSpans[y], pSpans + pRowSpans[y + 1] - 1, x,
+														[](int x, const cell_span &span) { return x < span.x; });
+		return pSpan - 1;
 	}
 
 	Point	CCell::d2h(CvPoint2D64f C) const
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "types.h"
+#include "LUTCache.h"
 
 const double MIN_RADIUS = 1.0;		///< Minimal allowed hexagon outer radius
 
@@ -16,10 +17,18 @@ namespace HexagonCells
 		int		N;		///< Number of hexagons in the image
 	} cell_params;
 
+	///@brief Cell row span structure: the pixels [x0; x1) of the image row y, which belong to the same cell
+	typedef struct {
+		int		y;		///< y-coordinate of the image row
+		int		x0;		///< x-coordinate of the first pixel of the span
+		int		x1;		///< x-coordinate of the pixel after the last pixel of the span
+	} cell_row_span;
+
 	/**
 	@brief Cell interpolation approach
 	@details The CELL_AVG approach returns the average value of all the pixels in the cell; the CELL_MV
-	approach returns the most frequent value of the pixels in the cell.
+	approach returns the most frequent value of the pixels in the cell (if several values are equally frequent, the one, which reaches
+	this frequency first in the raster order). Both approaches support images of any depth (CV_8U - CV_64F) and number of channels.
 	@warning The CELL_MV approach may return unexpected results on images with losely compression as JPEG
 	*/
 	enum cell_int_app {
@@ -27,11 +36,24 @@ namespace HexagonCells
 		CELL_MV			///< Majority voting approach
 	};
 
+	/**
+	@brief Cell statistics
+	@details The statistics are calculated in the same pass over the image as the cell colors (Ref. @ref CCell::setStatistics()).
+	Every statistic is stored in a single-row matrix with one element per cell, where N is the number of cells and C is the number of
+	the image channels.
+	*/
+	enum cell_stat {
+		CELL_STAT_COUNT		= 0x01,		///< Number of pixels in the cell Mat(1, N, CV_32SC1)
+		CELL_STAT_MIN		= 0x02,		///< Minimal pixel value of the cell Mat(1, N, CV_64FC(C))
+		CELL_STAT_MAX		= 0x04,		///< Maximal pixel value of the cell Mat(1, N, CV_64FC(C))
+		CELL_STAT_VAR		= 0x08,		///< Variance of the pixel values of the cell Mat(1, N, CV_64FC(C))
+		CELL_STAT_CENTROID	= 0x10		///< Centroid (x, y) of the pixels of the cell Mat(1, N, CV_64FC2)
+	};
+
 
 	// ================================ Cell Class ================================
 	/**
 	@brief Cell class
-	@todo Optimize the \b calculate_LUT() function
 	@todo Add sub-pixel accuracy support
 	@bug Images with resolution 640 x 480 pixels and cell radius R = 3.102 have an uncovered by cells regions at the right image edge.
 	@author Sergey G. Kosov, sergey.kosov@project-10.de
@@ -39,6 +61,11 @@ namespace HexagonCells
 	class CCell
 	{
 		friend class CMarker;
+		friend class CLUTCache;
+		friend class CCellStream;
+		friend class CCellReader;
+		friend class CCellBatch;
+		friend class CCellPyramid;
 
 	public:
 		/**
@@ -88,6 +115,39 @@ namespace HexagonCells
 		*/
 		DllExport void			  setImage(Mat &img);
 		/**
+		@brief (Re-) sets the image without copying it (non-owning view mode)
+		@details In contrast to @ref setImage(), the class keeps only a reference to the image data. The data is read when the cell colors
+		are calculated, \a i.e. by the first call of @ref getVal() or @ref getVals() after the image, the radius or the interpolation
+		approach is (re-) set. Therefore the data must stay valid and unchanged, until the image is re-set by @ref setImage() or
+		@ref bindImage(), @ref clear() is called or the class is destroyed.
+		@note If \b img owns its data, the data is kept alive by the reference counter of \b img, but must not be modified either
+		@param img The image
+		*/
+		DllExport void			  bindImage(const Mat &img);
+		/**
+		@brief (Re-) sets the image from a raw buffer without copying it (non-owning view mode)
+		@details The lifetime rules of @ref bindImage(const Mat &) apply to the buffer
+		@param pData Pointer to the first pixel of the image
+		@param size The image size
+		@param type The image type, \a e.g. CV_8UC3
+		@param step Number of bytes between the beginnings of two consecutive image rows; 0 for continuous images
+		*/
+		DllExport void			  bindImage(const void *pData, CvSize size, int type, size_t step = 0);
+		/**
+		@brief Updates the changed regions of the image
+		@details Only the cells, which intersect the changed rectangles, are re-calculated, thus the cost of an update depends on the changed
+		area rather than on the image size. In the CELL_AVG mode the class keeps the per-cell sums of the pixel values and updates them with
+		the differences between the new and the old pixels of the rectangles; otherwise the affected cells are re-calculated from their pixels.
+		If the image was set with @ref setImage(), the rectangles are copied into the own copy of the image; if it was bound with
+		@ref bindImage(), the new image is bound instead of the old one. The new image may also be the bound image itself, modified in place:
+		then the affected cells are re-calculated from their pixels.
+		@note If the cell statistics are enabled (Ref. @ref setStatistics()), or the cell colors are not calculated yet, all the cells are
+		re-calculated by the next call of @ref getVal() or @ref getVals()
+		@param img The new image of the same size and type as the current one, which differs from it only within the rectangles
+		@param vRects The changed rectangles
+		*/
+		DllExport void			  updateImage(const Mat &img, const std::vector<Rect> &vRects);
+		/**
 		@brief (Re-) sets the hexagon outer radius
 		@param R Hexagon outer radius
 		*/
@@ -97,6 +157,48 @@ namespace HexagonCells
 		@param cellIntApp Cell interpolation approach (Ref. @ref cell_int_app)
 		*/
 		DllExport void			  setInterpolationApproach(cell_int_app cellIntApp);
+		/**
+		@brief (Re-) sets the cell statistics to calculate
+		@details The selected statistics are accumulated in the same pass over the image as the cell colors and are available via @ref getStat()
+		@param stats Combination of the @ref cell_stat flags (0 by default)
+		*/
+		DllExport void			  setStatistics(int stats);
+		/**
+		@brief Enables or disables the accelerated calculation of the cell averages
+		@details In the accelerated mode the per-row prefix sums of the image are calculated once per image, and the sum of every cell is
+		taken from them over the cell spans in the image rows, instead of summing up all the cell pixels. Thus, after the radius is changed,
+		the cell averages are re-calculated much faster than with a full pass over the image. The prefix sums take 4 bytes per pixel and
+		channel for 8- and 16-bit images and 8 bytes otherwise.
+		@note The accelerated mode applies only to the CELL_AVG approach without the cell statistics (Ref. @ref setStatistics()); for 8- and
+		16-bit images it also needs the cells not wider than 65536 pixels, otherwise the pixels are summed up
+		@param enable \b true to enable the accelerated mode, \b false to disable it (default)
+		*/
+		DllExport void			  setPrefixSums(bool enable);
+		/**
+		@brief Performs all the lazy calculations of the class
+		@details Calculates the look-up table, the number of cells, the adjacency table and, if the image is set, the cell colors and the
+		enabled statistics. Each of these steps is parallelized internally. After this call the \b const versions of the accessors may be
+		used: they neither calculate nor allocate anything and may be called concurrently from any number of threads, as long as no
+		non-const function is called at the same time:
+		@code
+		CCell cell(img, R);
+		cell.prepare();
+		const CCell &grid = cell;
+		// any thread
+		int idx = grid.getIDX(x, y);
+		CvScalar val = grid.getVal(idx);
+		@endcode
+		@note Any setter invalidates the prepared data; @ref prepare() must then be called again
+		@param adjacency \b true to calculate the adjacency table, needed by the const @ref getNeighbourIDX() and @ref getAdjacency()
+		*/
+		DllExport void			  prepare(bool adjacency = true);
+		/**
+		@brief Checks whether the data needed by the const accessors is calculated
+		@param adjacency \b true to check the adjacency table as well
+		@retval true if the const accessors may be used (Ref. @ref prepare())
+		@retval false otherwise
+		*/
+		DllExport bool			  isPrepared(bool adjacency = true) const;
 
 		/**
 		@brief Returns the cell parameters
@@ -104,6 +206,11 @@ namespace HexagonCells
 		*/
 		DllExport cell_params	  getInfo(void);
 		/**
+		@brief Returns the cell parameters
+		@note Thread-safe; requires @ref prepare()
+		*/
+		DllExport cell_params	  getInfo(void) const;
+		/**
 		@brief Returns the cell index
 		@param x x-coordinate of a pixel in the image
 		@param y y-coordinate of a pixel in the image
@@ -112,6 +219,11 @@ namespace HexagonCells
 		*/
 		DllExport int			  getIDX(int x, int y);
 		/**
+		@brief Returns the cell index
+		@note Thread-safe; requires @ref prepare()
+		*/
+		DllExport int			  getIDX(int x, int y) const;
+		/**
 		@brief Returns the neighbouring cell index
 		@param idx Cell index
 		@param i Cell neighbour index in range from 0 till 5, which corresponds to the neighbours depicted at \b Fig. \b 1.
@@ -121,32 +233,237 @@ namespace HexagonCells
 		*/
 		DllExport int			  getNeighbourIDX(int idx, int i);
 		/**
+		@brief Returns the neighbouring cell index
+		@note Thread-safe; requires @ref prepare() with the adjacency table
+		*/
+		DllExport int			  getNeighbourIDX(int idx, int i) const;
+		/**
 		@brief Returns all 6 neighbouring cell indexs
 		@param idx Cell index
-		@return Array of the neighbouring cell indexes. The length of the array is 6 and each elemet corresponds
+		@return Array of the neighbouring cell indexes, which must be released with \b delete[]. The length of the array is 6 and each elemet corresponds
 		to neighbour, indexed according to the \b Fig. \b 1. from @ref getNeighbourIDX
 		. Neighbouring cell index
 		may be equal to -1 if the neighbour is beyond the image borders.
 		*/
 		DllExport int			* getNeighbourhood(int idx);
 		/**
+		@brief Returns all 6 neighbouring cell indexs
+		@details The same as @ref getNeighbourhood(int), but the indexes are written into a caller-supplied array
+		@param idx Cell index
+		@param[out] pDst Array of at least 6 elements
+		*/
+		DllExport void			  getNeighbourhood(int idx, int *pDst);
+		/**
+		@brief Returns the adjacency table
+		@details The adjacency table is calculated once per grid and contains for every cell its 6 neighbouring cell indexes, ordered
+		according to the \b Fig. \b 1. from @ref getNeighbourIDX (-1 for the neighbours beyond the image borders). The neighbours of
+		cell \a idx are the row \a idx of the table, thus iterating over the neighbours requires neither heap allocations nor calculations:
+		@code
+		Mat adjacency = cell.getAdjacency();
+		const int *pNeighbours = adjacency.ptr<int>(idx);
+		for (int i = 0; i < 6; i++)
+			if (pNeighbours[i] >= 0) ...
+		@endcode
+		@return The adjacency table Mat(N, 6, CV_32SC1), where N is the number of cells
+		@warning The returned matrix shares the data with the class and must not be modified
+		*/
+		DllExport Mat			  getAdjacency(void);
+		/**
+		@brief Returns the adjacency table
+		@note Thread-safe; requires @ref prepare() with the adjacency table
+		*/
+		DllExport Mat			  getAdjacency(void) const;
+		/**
+		@brief Returns the pixels of the specified cell
+		@details The pixels of the cell are given by its row spans, which are taken from the inverse look-up table (Ref. @ref getInverseLUT()),
+		thus iterating over the pixels of a cell takes time, proportional to the cell size:
+		@code
+		Mat spans = cell.getCellSpans(idx);
+		const cell_row_span *pSpans = spans.ptr<cell_row_span>(0);
+		for (int k = 0; k < spans.cols; k++)
+			for (int x = pSpans[k].x0; x < pSpans[k].x1; x++) ...			// pixel (x, pSpans[k].y) belongs to the cell idx
+		@endcode
+		@param idx Cell index
+		@return The row spans of the cell in the order of the image rows Mat(1, n, CV_32SC3) of cell_row_span (empty if the cell has no pixels)
+		@warning The returned matrix shares the data with the class and must not be modified
+		*/
+		DllExport Mat			  getCellSpans(int idx);
+		/**
+		@brief Returns the inverse look-up table
+		@details The inverse look-up table is calculated once per grid in the compressed sparse row form: the row spans of all the cells are
+		packed cell by cell in a single array, and the spans of the cell \a idx are the elements [offsets[idx]; offsets[idx + 1]) of this array.
+		@param[out] offsets The offsets of the cells Mat(1, N + 1, CV_32SC1), where N is the number of cells
+		@param[out] spans The row spans of all the cells Mat(1, nSpans, CV_32SC3) of cell_row_span
+		@warning The returned matrices share the data with the class and must not be modified
+		*/
+		DllExport void			  getInverseLUT(Mat &offsets, Mat &spans);
+		/**
+		@brief Returns the bounding rectangle of the specified cell
+		@param idx Cell index
+		@return The bounding rectangle of the cell pixels (empty if the cell has no pixels)
+		*/
+		DllExport Rect			  getBoundingRect(int idx);
+		/**
+		@brief Groups the similar neighbouring cells into connected components
+		@details Two neighbouring cells belong to the same component, if the Euclidean distance between their colors does not exceed the
+		threshold. The components are found with a parallel union-find over the 6-neighbourhood of the cells: the blocks of cells are
+		processed independently, and the trees of the neighbouring blocks are merged afterwards. The components are labeled in the order of
+		their first cells, \a i.e. the component of the cell 0 has the label 0.
+		@param threshold Maximal color distance between two neighbouring cells of a component
+		@param[out] pNumComponents Number of the components (optional)
+		@return The component labels Mat(1, N, CV_32SC1), where N is the number of cells
+		*/
+		DllExport Mat			  getComponents(double threshold, int *pNumComponents = NULL);
+		/**
+		@brief Calculates the distances from the source cells to all the cells
+		@details The distance is the length of the shortest path between the cells over the 6-neighbourhood, where the cost of a step between
+		two neighbouring cells is <em>1 + weight * d</em> and \a d is the Euclidean distance between their colors. Thus, for \b weight = 0
+		the distance is the number of steps on the hexagonal grid. The distances are calculated with alternating forward and backward sweeps
+		over the cells in the raster order, which are repeated until no distance changes: every sweep propagates the distances from the
+		already visited neighbours, thus the memory is accessed sequentially and no priority queue is needed.
+		@param vSources Indexes of the source cells
+		@param weight Weight of the color differences (0 by default)
+		@param[out] pNearest Index of the nearest source cell for every cell Mat(1, N, CV_32SC1) (optional)
+		@return The distances Mat(1, N, CV_64FC1), where N is the number of cells
+		*/
+		DllExport Mat			  getDistances(const std::vector<int> &vSources, double weight = 0, Mat *pNearest = NULL);
+		/**
 		@brief Returns the color of the specified cell
 		@param idx Cell index
-		@return Cell color
+		@return Cell color (the first 4 channels; Ref. @ref getVals() for images with more channels)
 		*/
 		DllExport CvScalar		  getVal(int idx);
+		/**
+		@brief Returns the color of the specified cell
+		@note Thread-safe; requires @ref prepare() with the image set
+		*/
+		DllExport CvScalar		  getVal(int idx) const;
+		/**
+		@brief Returns the colors of all the cells
+		@details The cell colors are stored contiguously in a single-row matrix Mat(1, N, CV_64FC(C)), where N is the number of cells
+		and C is the number of the image channels, thus the value of channel \a c of the cell \a idx is the element <em>C * idx + c</em>
+		of the data array.
+		@return The cell colors
+		@warning The returned matrix shares the data with the class and must not be modified
+		*/
+		DllExport Mat			  getVals(void);
+		/**
+		@brief Returns the colors of all the cells
+		@note Thread-safe; requires @ref prepare() with the image set
+		*/
+		DllExport Mat			  getVals(void) const;
+		/**
+		@brief Copies the colors of all the cells into a buffer
+		@details The layout of the buffer is the same as of the data array of @ref getVals(void)
+		@param[out] pDst Pointer to a buffer of at least N * C elements of the type, specified by \b depth
+		@param depth Type of the buffer elements: CV_8U, CV_32F or CV_64F. For CV_8U the values are rounded and saturated
+		*/
+		DllExport void			  getVals(void *pDst, int depth);
+		/**
+		@brief Calculates the colors of all the cells into a caller-supplied matrix
+		@details If the colors are not calculated yet, they are calculated directly into the data of \b dst, which is (re-) allocated
+		only if it has another size or type; otherwise they are copied. The working buffers of the calculation are kept by the class
+		between the images, thus the processing of a new image of the same size and radius, bound with @ref bindImage(), does not
+		allocate heap memory:
+		@code
+		Mat vals;
+		for (;;) {
+			cell.bindImage(frame);
+			cell.getVals(vals);			// vals keeps its buffer from frame to frame
+		}
+		@endcode
+		@note The statistics (Ref. @ref setStatistics()) are re-allocated for every image, since they are returned by @ref getStat()
+		with the shared data
+		@param[out] dst The cell colors in the format of @ref getVals(void). The matrix shares the data with the class until the image
+		is re-set, thus @ref updateImage() updates it as well
+		*/
+		DllExport void			  getVals(Mat &dst);
+		/**
+		@brief Returns the colors of all the cells for a set of the hexagon outer radii
+		@details The image, the interpolation approach and the image prefix sums (Ref. @ref setPrefixSums()) are shared between all the radii,
+		and the class state, including its own radius, remains unchanged. For the CELL_AVG approach the prefix sums are always used, but
+		they are kept after the call only in the accelerated mode.
+		@param vR Hexagon outer radii
+		@return The cell colors for every radius in the format of @ref getVals(void)
+		*/
+		DllExport vec_mat_t		  getVals(const std::vector<double> &vR);
+		/**
+		@brief Returns the colors of the specified cells
+		@details If the colors of all the cells are not calculated yet, only the specified cells are calculated from their pixels, and the results
+		are memoized until the image, the radius or the interpolation approach is changed. Thus, the cost of the call depends on the number of
+		the not yet calculated cells rather than on the image size.
+		@note The cell statistics are not calculated (Ref. @ref setStatistics())
+		@param vIdx Cell indexes
+		@return The cell colors Mat(1, n, CV_64FC(C)) in the order of \b vIdx, where n is the number of the indexes and C is the number of the image channels
+		*/
+		DllExport Mat			  getCellVals(const std::vector<int> &vIdx);
+		/**
+		@brief Returns the colors of the cells, which intersect a region of the image
+		@details Only the cells of the region are calculated (Ref. @ref getCellVals(const std::vector<int> &))
+		@param roi The region of interest
+		@param[out] pvIdx Indexes of the cells in ascending order (optional)
+		@return The cell colors Mat(1, n, CV_64FC(C)) in the order of the cell indexes, where n is the number of the cells in the region
+		*/
+		DllExport Mat			  getCellVals(const Rect &roi, std::vector<int> *pvIdx = NULL);
+		/**
+		@brief Returns a statistic of all the cells
+		@details The variance is the population variance of the pixel values of the cell; the statistics of the cells without pixels are 0
+		@param stat The statistic, which must be enabled with @ref setStatistics() (Ref. @ref cell_stat)
+		@return The statistic Mat(1, N, type), where N is the number of cells and the type is given in @ref cell_stat
+		@warning The returned matrix shares the data with the class and must not be modified
+		*/
+		DllExport Mat			  getStat(cell_stat stat);
+		/**
+		@brief Saves the cell data into a binary file
+		@details The file contains the cell parameters, the image size, the cell colors and optionally the adjacency table. It is laid out
+		to be memory-mapped by @ref CCellReader, which provides the same index-based queries as this class (Ref. @ref cell_file_header)
+		@param fileName The file name
+		@param adjacency \b true to store the adjacency table as well
+		@return 0 on success, -1 otherwise
+		*/
+		DllExport int			  save(const std::string &fileName, bool adjacency = false);
 
 		// Brute - force functions
-		DllExport Mat			  getLUT(void) { return m_LUT; }
-		DllExport void			  setLUT(Mat &LUT) { LUT.copyTo(m_LUT); }
+		/**
+		@brief Returns the dense look-up table
+		@details The class stores the look-up table as a per-row span index (Ref. @ref lut_data); the dense table with the cell index for every
+		pixel is materialized by the first call of this function and kept until the image size or the radius is changed.
+		@return The look-up table Mat(imgSize, CV_32SC1)
+		@warning The returned matrix shares the data with the class and must not be modified
+		*/
+		DllExport Mat			  getLUT(void);
+		/**
+		@brief Sets the dense look-up table
+		@param LUT The look-up table Mat(imgSize, CV_32SC1)
+		*/
+		DllExport void			  setLUT(Mat &LUT);
 
 
 	private:
+		struct scratch_data;			// Working buffers of the calculation of the cell colors (defined in Cell.cpp)
+		typedef std::shared_ptr<scratch_data> ptr_scratch_t;
+
+		void setImageSize(CvSize imgSize);
+		void releaseStats(void);
+		void releasePrefix(void);		// keeps the buffer of the prefix sums for the next image in the accelerated mode, releases it otherwise
+		scratch_data & getScratch(void);
 		int calculate_LUT(void);		// 0 on success, error_code otherwise
+		static void getRowWidths(CvSize imgSize, double R, int &width0, int &width1);	// numbers of the cells in the even and in the odd cell rows
+		static ptr_lut_t buildLUT(CvSize imgSize, double R);
+		static ptr_lut_t encodeLUT(const Mat &LUT);
+		static void calculateLUTRow(CvSize imgSize, double R, int y, int *pLUT);	// one row of the dense look-up table
+		static int getMinIDX(CvSize imgSize, double R, int y);						// minimal cell index in the image rows [y; height)
 		int calculate_nCells(void);		// 0 on success, error_code otherwise
+		int calculate_adjacency(void);	// 0 on success, error_code otherwise
+		int calculate_inverseLUT(void);	// 0 on success, error_code otherwise
+		static int labelComponents(const Mat &cellData, const Mat &adjacency, double threshold, Mat &labels);	// returns the number of components
+		static bool isPrefixExact(int depth, double R);	// true if the modular prefix sums give the exact sums of the cell spans of the radius R
+		int calculate_prefix(void);		// 0 on success, error_code otherwise
+		int calculate_cell(int idx, double *pVal, double *pSum, std::vector<double> &vValues);	// color (and the sum for CELL_AVG) of a single cell from its pixels, returns the number of pixels
 		int calculate_cellData(void);	// 0 on success, error_code otherwise
+		int calculate_cellData_AVG(void);
+		int calculate_cellData_MV(void);
 
-		bool				  ifInsideCell(CvPoint2D64f x, CvPoint2D64f C) const;
 		static CvPoint2D64f   getBoundaryPoint(CvPoint2D64f C, int i, double R);
 
 
@@ -154,20 +471,38 @@ namespace HexagonCells
 		static Point		  idx2h(int idx, double R, CvSize imgSize);			// index to hexagonal
 		inline int			  h2idx(Point c) const;			// hexagonal to index
 		static CvPoint2D64f	  idx2d(int idx, double R, CvSize imgSize);			// index to cartesian
-		inline int			  d2idx(CvPoint2D64f C);							// cartesian to index
+		inline int			  d2idx(CvPoint2D64f C) const;					// cartesian to index (requires the look-up table)
+		inline const cell_span * findSpan(int y, int x) const;				// span of the image row y, which contains the pixel x (requires the look-up table)
 	//	static CvPoint2D64f	  h2d(Point c);
 		inline Point		  d2h(CvPoint2D64f C) const;						// cartesian to hexagonal
 
 
 	private:
-		Mat				m_img;			// Mat();			// The image
+		Mat				m_img;			// Mat();			// The image (own copy or a view of the caller's data, Ref. bindImage())
 		CvSize			m_imgSize;		// cvSize(0, 0);	// 
-		Mat				m_LUT;			// Mat();			// Look-up table Mat(m_imgSize, CV_32SC1)
+		Mat				m_LUT;			// Mat();			// Dense look-up table Mat(m_imgSize, CV_32SC1) (Ref. getLUT())
+		ptr_lut_t		m_pLUT;			// NULL;			// Look-up table span index (shared via CLUTCache, or own if set via setLUT())
 		double			m_R;			// -1;				// Hexagon outer radius
 		double			m_r;			// -1;				// Hexagon inner radius
 		int				m_nCells;		// -1;				// Number of of hexagons in the image
+		Mat				m_adjacency;	// Mat();			// Adjacency table Mat(m_nCells, 6, CV_32SC1)
+		Mat				m_cellOffsets;	// Mat();			// Inverse look-up table: offsets of the cells in m_cellSpans Mat(1, m_nCells + 1, CV_32SC1)
+		Mat				m_cellSpans;	// Mat();			// Inverse look-up table: row spans of all the cells Mat(1, nSpans, CV_32SC3)
 		cell_int_app	m_cellIntApp;	// CELL_AVG;		// Cell interpolation approach
+		int				m_cellStats;	// 0;				// Cell statistics flags (Ref. cell_stat)
+		bool			m_usePrefix;	// false;			// Accelerated mode flag (Ref. setPrefixSums())
+		bool			m_imgView;		// false;			// The image is a view of the caller's data (Ref. bindImage())
+		Mat				m_prefix;		// Mat();			// Per-row prefix sums of the image Mat(rows, cols + 1, CV_32SC(C) or CV_64FC(C))
 		Mat				m_cellData;		// Mat();			// Direct cell datas
+		Mat				m_cellSum;		// Mat();			// Sums of the pixel values of every cell Mat(1, m_nCells, CV_64FC(C)), calculated with m_cellData in the CELL_AVG mode (Ref. updateImage())
+		Mat				m_sparseData;	// Mat();			// Memoized colors of the separately calculated cells Mat(1, m_nCells, CV_64FC(C)) (Ref. getCellVals())
+		Mat				m_sparseMask;	// Mat();			// Flags of the memoized cells Mat(1, m_nCells, CV_8UC1)
+		Mat				m_cellCount;	// Mat();			// Number of pixels of every cell Mat(1, m_nCells, CV_32SC1)
+		Mat				m_cellMin;		// Mat();			// Minimal pixel value of every cell Mat(1, m_nCells, CV_64FC(C))
+		Mat				m_cellMax;		// Mat();			// Maximal pixel value of every cell Mat(1, m_nCells, CV_64FC(C))
+		Mat				m_cellVar;		// Mat();			// Variance of the pixel values of every cell Mat(1, m_nCells, CV_64FC(C))
+		Mat				m_cellCentroid;	// Mat();			// Centroid of every cell Mat(1, m_nCells, CV_64FC2)
+		ptr_scratch_t	m_pScratch;		// NULL;			// Working buffers, kept between the images (Ref. getVals(Mat &))
 
 
 
@@ -0,0 +1,109 @@
+#include "CellBatch.h"
+#include "macroses.h"
+
+namespace HexagonCells
+{
+	// =================== Auxilary functions ==================
+	namespace {
+		// Worker loop: every worker takes the next image from the queue, as soon as it finishes the previous one
+		class CBatchBody : public ParallelLoopBody
+		{
+		public:
+			CBatchBody(std::vector<CCell *> &vpWorkers, CvSize imgSize, const std::function<bool(Mat &)> &source, const std::function<void(int, const Mat &)> &sink, std::mutex &mutex, int &nImages)
+				: m_vpWorkers(vpWorkers), m_imgSize(imgSize), m_source(source), m_sink(sink), m_mutex(mutex), m_nImages(nImages) {}
+
+			virtual void operator()(const Range &range) const
+			{
+				for (int w = range.start; w < range.end; w++) {
+					CCell &cell = *m_vpWorkers[w];
+					for (;;) {
+						Mat img;
+						int idx;
+						{
+							std::lock_guard<std::mutex> lock(m_mutex);
+							if (!m_source(img)) break;
+							idx = m_nImages++;
+						}
+						HCELL_ASSERT_MSG((img.cols == m_imgSize.width) && (img.rows == m_imgSize.height), "The image size (%d x %d) does not match the batch image size (%d x %d)", img.cols, img.rows, m_imgSize.width, m_imgSize.height);
+
+						cell.bindImage(img);
+						Mat vals = cell.getVals();		// re-allocated for every image, since the previous result is passed to the sink
+
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_sink(idx, vals);
+					} // forever
+				} // w
+			}
+
+
+		private:
+			std::vector<CCell *>						&m_vpWorkers;
+			CvSize										 m_imgSize;
+			const std::function<bool(Mat &)>			&m_source;
+			const std::function<void(int, const Mat &)>	&m_sink;
+			std::mutex									&m_mutex;
+			int											&m_nImages;
+		};
+	}
+
+	// Constructor
+	CCellBatch::CCellBatch(CvSize imgSize, double R, cell_int_app cellIntApp, int nWorkers) : m_imgSize(imgSize)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((imgSize.height != 0) && (imgSize.width != 0), "The image size is not set");
+		HCELL_ASSERT_MSG(R >= MIN_RADIUS, "The cell radius is not set or has a wrong value");
+
+		if (nWorkers <= 0) nWorkers = getNumThreads();
+		m_vpWorkers.resize(nWorkers);
+		for (CCell * &pWorker : m_vpWorkers) pWorker = new CCell(imgSize, R, cellIntApp);
+
+		// The grid is built once and shared by all the workers
+		m_vpWorkers[0]->prepare(false);
+		for (int w = 1; w < nWorkers; w++) {
+			m_vpWorkers[w]->m_pLUT	 = m_vpWorkers[0]->m_pLUT;
+			m_vpWorkers[w]->m_nCells = m_vpWorkers[0]->m_nCells;
+		}
+
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_stats.nWorkers = nWorkers;
+	}
+
+	// Destructor
+	CCellBatch::~CCellBatch(void)
+	{
+		for (CCell *pWorker : m_vpWorkers) delete pWorker;
+	}
+
+	vec_mat_t CCellBatch::process(const vec_mat_t &vImgs)
+	{
+		vec_mat_t res(vImgs.size());
+		size_t	  next = 0;
+		process([&](Mat &img) { if (next == vImgs.size()) return false; img = vImgs[next++]; return true; },
+				[&](int idx, const Mat &vals) { res[idx] = vals; });
+		return res;
+	}
+
+	int CCellBatch::process(const std::function<bool(Mat &)> &source, const std::function<void(int, const Mat &)> &sink)
+	{
+		const int	nWorkers = getNumWorkers();
+		std::mutex	mutex;
+		int			nImages	 = 0;
+
+		int64 ticks = getTickCount();
+		parallel_for_(Range(0, nWorkers), CBatchBody(m_vpWorkers, m_imgSize, source, sink, mutex, nImages), nWorkers);
+		double time = static_cast<double>(getTickCount() - ticks) / getTickFrequency();
+
+		m_stats.nImages			= nImages;
+		m_stats.nWorkers		= nWorkers;
+		m_stats.time			= time;
+		m_stats.imagesPerSecond = (time > 0) ? nImages / time : 0;
+		m_stats.pixelsPerSecond = (time > 0) ? static_cast<double>(nImages) * m_imgSize.width * m_imgSize.height / time : 0;
+		return nImages;
+	}
+
+	cell_params CCellBatch::getInfo(void) const
+	{
+		const CCell &cell = *m_vpWorkers[0];
+		return cell.getInfo();
+	}
+}
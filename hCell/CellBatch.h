@@ -0,0 +1,88 @@
+// Cell Batch class
+#pragma once
+
+#include "Cell.h"
+#include <functional>
+#include <mutex>
+
+namespace HexagonCells
+{
+	///@brief Batch processing statistics structure
+	typedef struct {
+		int		nImages;			///< Number of the processed images
+		int		nWorkers;			///< Number of the workers
+		double	time;				///< Processing time in seconds
+		double	imagesPerSecond;	///< Throughput in images per second
+		double	pixelsPerSecond;	///< Throughput in pixels per second
+	} batch_stats;
+
+	// ================================ Cell Batch Class ================================
+	/**
+	@brief Cell batch class
+	@details This class calculates the cell colors of many images of the same size with the same hexagon grid. The grid (the look-up
+	table and the number of cells) is built once and shared by all the workers. Every worker owns a CCell instance, which keeps its
+	buffers between the images and binds the images without copying them (Ref. @ref CCell::bindImage()). The workers take the next
+	image from the common queue, as soon as they finish the previous one, thus the load is balanced for the images of different
+	processing costs:
+	@code
+	CCellBatch batch(imgSize, R);
+	vec_mat_t vVals = batch.process(vImgs);			// the colors of every image in the format of CCell::getVals(void)
+	batch_stats stats = batch.getStats();
+	@endcode
+	*/
+	class CCellBatch
+	{
+	public:
+		/**
+		@brief Constuctor
+		@param imgSize The size of all the images
+		@param R Hexagon outer radius
+		@param cellIntApp Cell interpolation approach (Ref. @ref cell_int_app)
+		@param nWorkers Number of the workers; 0 for the number of threads of the OpenCV thread pool
+		*/
+		DllExport CCellBatch(CvSize imgSize, double R, cell_int_app cellIntApp = CELL_AVG, int nWorkers = 0);
+		DllExport ~CCellBatch(void);
+
+		/**
+		@brief Processes a collection of images
+		@param vImgs The images of the size, given in the constructor. The image data must stay valid and unchanged during the call
+		@return The cell colors of every image in the format of @ref CCell::getVals(void)
+		*/
+		DllExport vec_mat_t		process(const vec_mat_t &vImgs);
+		/**
+		@brief Processes a queue of images
+		@details The workers request the images from the \b source, until it returns \b false, and pass the results to the \b sink. Both
+		functions are called under a lock, thus they need not be thread-safe; the results may come in any order.
+		@param source Function, which writes the next image into its argument and returns \b true, or returns \b false if the queue is
+		empty. The image data must stay valid and unchanged, until its result is passed to the \b sink
+		@param sink Function, which receives the index of the image in the order of the \b source and its cell colors
+		@return The number of the processed images
+		*/
+		DllExport int			process(const std::function<bool(Mat &)> &source, const std::function<void(int, const Mat &)> &sink);
+		/**
+		@brief Returns the statistics of the last call of @ref process()
+		@return %batch_stats structure (Ref. @ref batch_stats)
+		*/
+		DllExport batch_stats	getStats(void) const { return m_stats; }
+		/**
+		@brief Returns the cell parameters
+		@return %cell_params structure (Ref. @ref cell_params)
+		*/
+		DllExport cell_params	getInfo(void) const;
+		/**
+		@brief Returns the number of the workers
+		*/
+		DllExport int			getNumWorkers(void) const { return static_cast<int>(m_vpWorkers.size()); }
+
+
+	private:
+		CvSize					m_imgSize;		//				// The size of all the images
+		std::vector<CCell *>	m_vpWorkers;	//				// Per-worker cells, sharing the same look-up table
+		batch_stats				m_stats;		//				// Statistics of the last call of process()
+
+
+		// Copy semantics are disabled
+		CCellBatch(const CCellBatch &rhs) {}
+		const CCellBatch & operator= (const CCellBatch & rhs) { return *this; }
+	};
+}
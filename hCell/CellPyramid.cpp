@@ -0,0 +1,172 @@
+#include "CellPyramid.h"
+#include "macroses.h"
+
+namespace HexagonCells
+{
+	// Constructor
+	CCellPyramid::CCellPyramid(CvSize imgSize, double R, int nLevels) : m_imgSize(imgSize)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((imgSize.height != 0) && (imgSize.width != 0), "The image size is not set");
+		HCELL_ASSERT_MSG(R >= MIN_RADIUS, "The cell radius is not set or has a wrong value");
+		HCELL_ASSERT_MSG(nLevels > 0, "The number of levels must be positive");
+
+		m_vpLevels.resize(nLevels);
+		for (int l = 0; l < nLevels; l++) {
+			m_vpLevels[l] = new CCell(imgSize, R * (1 << l));
+			m_vpLevels[l]->prepare(false);
+		}
+
+		// The parent of a cell is the cell of the next level, which contains its centre
+		m_vParents.resize(nLevels - 1);
+		m_vChildOffsets.resize(nLevels - 1);
+		m_vChildren.resize(nLevels - 1);
+		for (int l = 0; l < nLevels - 1; l++) {
+			const CCell	&fine	= *m_vpLevels[l];
+			const CCell	&coarse = *m_vpLevels[l + 1];
+			const int	 nFine	 = fine.getInfo().N;
+			const int	 nCoarse = coarse.getInfo().N;
+
+			m_vParents[l].create(1, MAX(nFine, 1), CV_32SC1);
+			int *pParents = m_vParents[l].ptr<int>(0);
+			for (int idx = 0; idx < nFine; idx++) {
+				CvPoint2D64f centre = CCell::idx2d(idx, fine.m_R, imgSize);
+				int x = MIN(MAX(static_cast<int>(centre.x), 0), imgSize.width - 1);
+				int y = MIN(MAX(static_cast<int>(centre.y), 0), imgSize.height - 1);
+				pParents[idx] = coarse.getIDX(x, y);
+			}
+
+			// Children in the compressed sparse row form
+			m_vChildOffsets[l].create(1, nCoarse + 1, CV_32SC1);
+			int *pOffsets = m_vChildOffsets[l].ptr<int>(0);
+			std::fill(pOffsets, pOffsets + nCoarse + 1, 0);
+			for (int idx = 0; idx < nFine; idx++) pOffsets[pParents[idx] + 1]++;
+			for (int idx = 0; idx < nCoarse; idx++) pOffsets[idx + 1] += pOffsets[idx];
+
+			m_vChildren[l].create(1, MAX(nFine, 1), CV_32SC1);
+			int				*pChildren = m_vChildren[l].ptr<int>(0);
+			std::vector<int> vPos(pOffsets, pOffsets + nCoarse);
+			for (int idx = 0; idx < nFine; idx++) pChildren[vPos[pParents[idx]]++] = idx;
+		} // l
+
+		// The numbers of pixels of the finest cells are taken from the spans of the look-up table and aggregated to the coarser levels
+		m_vCounts.resize(nLevels);
+		for (int l = 0; l < nLevels; l++) {
+			const int nCells = m_vpLevels[l]->getInfo().N;
+			m_vCounts[l].create(1, MAX(nCells, 1), CV_32SC1);
+			m_vCounts[l].setTo(0);
+		}
+		const lut_data	&lut	 = *m_vpLevels[0]->m_pLUT;
+		const cell_span	*pSpans	 = lut.spans.ptr<cell_span>(0);
+		const int		 nSpans	 = lut.rowSpans.at<int>(0, imgSize.height);
+		int				*pCounts = m_vCounts[0].ptr<int>(0);
+		for (int k = 0; k < nSpans; k++)
+			if (pSpans[k].idx >= 0) pCounts[pSpans[k].idx] += pSpans[k + 1].x - pSpans[k].x;
+		for (int l = 1; l < nLevels; l++) {
+			const int  nFine		= m_vpLevels[l - 1]->getInfo().N;
+			const int *pParents		= m_vParents[l - 1].ptr<int>(0);
+			const int *pFineCounts	= m_vCounts[l - 1].ptr<int>(0);
+			int		  *pCoarseCounts = m_vCounts[l].ptr<int>(0);
+			for (int idx = 0; idx < nFine; idx++) pCoarseCounts[pParents[idx]] += pFineCounts[idx];
+		}
+	}
+
+	// Destructor
+	CCellPyramid::~CCellPyramid(void)
+	{
+		for (CCell *pLevel : m_vpLevels) delete pLevel;
+	}
+
+	void CCellPyramid::setImage(const Mat &img)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((img.cols == m_imgSize.width) && (img.rows == m_imgSize.height), "The image size (%d x %d) does not match the pyramid image size (%d x %d)", img.cols, img.rows, m_imgSize.width, m_imgSize.height);
+
+		const int nLevels = getNumLevels();
+		const int C		  = img.channels();
+		m_vVals.resize(nLevels);
+
+		// The finest level is calculated from the pixels
+		CCell &cell = *m_vpLevels[0];
+		cell.bindImage(img);
+		m_vVals[0] = cell.getVals();
+		cell.m_img.release();									// the image is not referenced after the call
+
+		// The coarser levels are aggregated from the sums of the finer ones
+		std::vector<double> vSums(static_cast<size_t>(cell.getInfo().N) * C);
+		const double *pVals0   = m_vVals[0].ptr<double>(0);
+		const int	 *pCounts0 = m_vCounts[0].ptr<int>(0);
+		for (size_t i = 0; i < vSums.size(); i++) vSums[i] = pVals0[i] * pCounts0[i / C];
+
+		for (int l = 1; l < nLevels; l++) {
+			const int  nCells	= m_vpLevels[l]->getInfo().N;
+			const int  nFine	= m_vpLevels[l - 1]->getInfo().N;
+			const int *pParents = m_vParents[l - 1].ptr<int>(0);
+			const int *pCounts	= m_vCounts[l].ptr<int>(0);
+
+			std::vector<double> vCoarseSums(static_cast<size_t>(nCells) * C, 0);
+			for (int idx = 0; idx < nFine; idx++)
+				for (int c = 0; c < C; c++) vCoarseSums[C * pParents[idx] + c] += vSums[C * idx + c];
+
+			m_vVals[l].create(1, MAX(nCells, 1), CV_MAKE_TYPE(CV_64F, C));
+			double *pVals = m_vVals[l].ptr<double>(0);
+			for (int idx = 0; idx < nCells; idx++)
+				for (int c = 0; c < C; c++) pVals[C * idx + c] = (pCounts[idx] > 0) ? vCoarseSums[C * idx + c] / pCounts[idx] : 0;
+
+			vSums.swap(vCoarseSums);
+		} // l
+	}
+
+	cell_params CCellPyramid::getInfo(int level) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((level >= 0) && (level < getNumLevels()), "The level %d is out of range", level);
+
+		const CCell &cell = *m_vpLevels[level];
+		return cell.getInfo();
+	}
+
+	int CCellPyramid::getIDX(int level, int x, int y) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((level >= 0) && (level < getNumLevels()), "The level %d is out of range", level);
+
+		const CCell &cell = *m_vpLevels[level];
+		return cell.getIDX(x, y);
+	}
+
+	int CCellPyramid::getParentIDX(int level, int idx) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((level >= 0) && (level < getNumLevels()), "The level %d is out of range", level);
+
+		if (level == getNumLevels() - 1) return -1;
+		return m_vParents[level].at<int>(0, idx);
+	}
+
+	Mat CCellPyramid::getChildren(int level, int idx) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((level >= 0) && (level < getNumLevels()), "The level %d is out of range", level);
+
+		if (level == 0) return Mat();
+		const int *pOffsets = m_vChildOffsets[level - 1].ptr<int>(0);
+		if (pOffsets[idx] == pOffsets[idx + 1]) return Mat();
+		return m_vChildren[level - 1].colRange(pOffsets[idx], pOffsets[idx + 1]);
+	}
+
+	Mat CCellPyramid::getVals(int level) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((level >= 0) && (level < getNumLevels()), "The level %d is out of range", level);
+		HCELL_ASSERT_MSG(!m_vVals.empty(), "The image is not set");
+		return m_vVals[level];
+	}
+
+	Mat CCellPyramid::getCounts(int level) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((level >= 0) && (level < getNumLevels()), "The level %d is out of range", level);
+		return m_vCounts[level];
+	}
+}
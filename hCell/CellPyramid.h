@@ -0,0 +1,106 @@
+// Cell Pyramid class
+#pragma once
+
+#include "Cell.h"
+
+namespace HexagonCells
+{
+	// ================================ Cell Pyramid Class ================================
+	/**
+	@brief Cell pyramid class
+	@details This class represents an image with a hierarchy of hexagonal grids with the outer radii <em>R, 2R, 4R, ...</em>. Only the finest
+	level is calculated from the pixels; every cell of a coarser level is the parent of the cells of the finer level, whose centres it contains,
+	and its color is the average of the children colors, weighted with their numbers of pixels. The parent / child mapping depends only on the
+	grids and is calculated once in the constructor, thus building of all the levels costs little more than building of the finest level:
+	@code
+	CCellPyramid pyramid(img.size(), R, 4);
+	pyramid.setImage(img);
+	Mat vals = pyramid.getVals(2);							// the colors of the level with the radius 4R
+	int parent = pyramid.getParentIDX(0, idx);				// the index of the level 1 cell, containing the cell idx of the level 0
+	@endcode
+	@note The coarser levels approximate the cells of the corresponding radii, since the children may overlap the boundaries of their parents
+	*/
+	class CCellPyramid
+	{
+	public:
+		/**
+		@brief Constuctor
+		@param imgSize The image size
+		@param R Hexagon outer radius of the finest level
+		@param nLevels Number of the levels
+		*/
+		DllExport CCellPyramid(CvSize imgSize, double R, int nLevels);
+		DllExport ~CCellPyramid(void);
+
+		/**
+		@brief (Re-) calculates all the levels for an image
+		@details The image is not referenced after the call
+		@param img The image of the size, given in the constructor
+		*/
+		DllExport void			setImage(const Mat &img);
+
+		/**
+		@brief Returns the number of the levels
+		*/
+		DllExport int			getNumLevels(void) const { return static_cast<int>(m_vpLevels.size()); }
+		/**
+		@brief Returns the cell parameters of a level
+		@param level Level index (0 for the finest level)
+		@return %cell_params structure (Ref. @ref cell_params)
+		*/
+		DllExport cell_params	getInfo(int level) const;
+		/**
+		@brief Returns the cell index in a level
+		@param level Level index
+		@param x x-coordinate of a pixel in the image
+		@param y y-coordinate of a pixel in the image
+		@return Index of the cell of the level, to which the pixel belongs
+		*/
+		DllExport int			getIDX(int level, int x, int y) const;
+		/**
+		@brief Returns the parent of a cell
+		@param level Level index of the cell
+		@param idx Cell index
+		@retval Index of the parent cell in the level \b level + 1
+		@retval -1 If the level is the coarsest one
+		*/
+		DllExport int			getParentIDX(int level, int idx) const;
+		/**
+		@brief Returns the children of a cell
+		@param level Level index of the cell
+		@param idx Cell index
+		@return Indexes of the child cells in the level \b level - 1 in ascending order Mat(1, n, CV_32SC1) (empty for the finest level or if the cell has no children)
+		@warning The returned matrix shares the data with the class and must not be modified
+		*/
+		DllExport Mat			getChildren(int level, int idx) const;
+		/**
+		@brief Returns the colors of all the cells of a level
+		@param level Level index
+		@return The cell colors in the format of @ref CCell::getVals(void)
+		@warning The returned matrix shares the data with the class and must not be modified
+		*/
+		DllExport Mat			getVals(int level) const;
+		/**
+		@brief Returns the numbers of pixels of all the cells of a level
+		@param level Level index
+		@return The numbers of pixels Mat(1, N, CV_32SC1), where N is the number of the cells of the level
+		@warning The returned matrix shares the data with the class and must not be modified
+		*/
+		DllExport Mat			getCounts(int level) const;
+
+
+	private:
+		CvSize					m_imgSize;			//				// The image size
+		std::vector<CCell *>	m_vpLevels;			//				// Grids of the levels
+		vec_mat_t				m_vParents;			//				// Parents of the cells of every level but the coarsest Mat(1, N, CV_32SC1)
+		vec_mat_t				m_vChildOffsets;	//				// Offsets of the children of the cells of every level but the finest Mat(1, N + 1, CV_32SC1)
+		vec_mat_t				m_vChildren;		//				// Children of the cells of every level but the finest, packed cell by cell Mat(1, n, CV_32SC1)
+		vec_mat_t				m_vVals;			//				// Cell colors of every level Mat(1, N, CV_64FC(C))
+		vec_mat_t				m_vCounts;			//				// Numbers of pixels of the cells of every level Mat(1, N, CV_32SC1) (depend only on the grids)
+
+
+		// Copy semantics are disabled
+		CCellPyramid(const CCellPyramid &rhs) {}
+		const CCellPyramid & operator= (const CCellPyramid & rhs) { return *this; }
+	};
+}
@@ -0,0 +1,129 @@
+#include "CellReader.h"
+#include "MappedFile.h"
+#include "macroses.h"
+
+namespace HexagonCells
+{
+	// Constructor
+	CCellReader::CCellReader(void) : m_pFile(NULL), m_imgSize(cvSize(0, 0))
+	{
+		memset(&m_params, 0, sizeof(m_params));
+	}
+
+	// Destructor
+	CCellReader::~CCellReader(void)
+	{
+		close();
+	}
+
+	bool CCellReader::open(const std::string &fileName)
+	{
+		close();
+
+		CMappedFile *pFile = new CMappedFile();
+		if (!pFile->open(fileName)) {
+			delete pFile;
+			return false;
+		}
+
+		// Validation of the header and of the array bounds
+		cell_file_header header;
+		bool res = pFile->size() >= sizeof(header);
+		if (res) {
+			memcpy(&header, pFile->data(), sizeof(header));
+			res &= memcmp(header.magic, CELL_FILE_MAGIC, sizeof(header.magic)) == 0;
+			res &= header.version == CELL_FILE_VERSION;
+			res &= (header.width > 0) && (header.height > 0) && (header.R >= MIN_RADIUS) && (header.nCells >= 0);
+			res &= (header.channels > 0) && (header.channels <= CV_CN_MAX);
+		}
+		if (res) {
+			size_t valuesSize	 = static_cast<size_t>(header.nCells) * header.channels * sizeof(double);
+			size_t adjacencySize = static_cast<size_t>(header.nCells) * 6 * sizeof(int);
+			res &= (header.valuesOffset >= sizeof(header)) && (header.valuesOffset % 8 == 0) && (header.valuesOffset + valuesSize <= pFile->size());
+			if (header.flags & CELL_FILE_ADJACENCY)
+				res &= (header.adjacencyOffset >= sizeof(header)) && (header.adjacencyOffset % 8 == 0) && (header.adjacencyOffset + adjacencySize <= pFile->size());
+		}
+		if (res) {
+			// the number of cells of the grid (the look-up table is taken from the cache and is reused by getIDX())
+			CCell cell(cvSize(header.width, header.height), header.R);
+			res &= cell.getInfo().N == header.nCells;
+		}
+		if (!res) {
+			delete pFile;
+			return false;
+		}
+
+		m_pFile		= pFile;
+		m_imgSize	= cvSize(header.width, header.height);
+		m_params.R	= header.R;
+		m_params.r	= header.r;
+		m_params.S	= header.S;
+		m_params.N	= header.nCells;
+
+		byte *pData = const_cast<byte *>(m_pFile->data());
+		m_vals = Mat(1, header.nCells, CV_64FC(header.channels), pData + header.valuesOffset);
+		if (header.flags & CELL_FILE_ADJACENCY) m_adjacency = Mat(header.nCells, 6, CV_32SC1, pData + header.adjacencyOffset);
+
+		m_cell.clear();
+		m_cell.setImageSize(m_imgSize);
+		m_cell.setRadius(header.R);
+
+		return true;
+	}
+
+	void CCellReader::close(void)
+	{
+		m_vals.release();
+		m_adjacency.release();
+		m_cell.clear();
+		if (m_pFile) {
+			delete m_pFile;
+			m_pFile = NULL;
+		}
+		m_imgSize = cvSize(0, 0);
+		memset(&m_params, 0, sizeof(m_params));
+	}
+
+	cell_params CCellReader::getInfo(void) const
+	{
+		return m_params;
+	}
+
+	int CCellReader::getIDX(int x, int y)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(m_pFile != NULL, "The cell file is not open");
+		return m_cell.getIDX(x, y);
+	}
+
+	int CCellReader::getNeighbourIDX(int idx, int i)
+	{
+		Mat adjacency = getAdjacency();
+
+		// Assertions
+		HCELL_ASSERT_MSG((idx >= 0) && (idx < adjacency.rows), "The cell index %d is out of range [0; %d)", idx, adjacency.rows);
+		if ((i < 0) || (i > 5)) return -1;
+		return adjacency.ptr<int>(idx)[i];
+	}
+
+	Mat CCellReader::getAdjacency(void)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(m_pFile != NULL, "The cell file is not open");
+		if (m_adjacency.empty()) m_adjacency = m_cell.getAdjacency();
+		return m_adjacency;
+	}
+
+	CvScalar CCellReader::getVal(int idx) const
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(m_pFile != NULL, "The cell file is not open");
+		HCELL_ASSERT_MSG((idx >= 0) && (idx < m_params.N), "The cell index %d is out of range [0; %d)", idx, m_params.N);
+
+		CvScalar res = cvScalarAll(0);
+		const int C = m_vals.channels();
+		const double *pVal = m_vals.ptr<double>(0) + static_cast<size_t>(C) * idx;
+		for (int c = 0; c < MIN(C, 4); c++) res.val[c] = pVal[c];
+		return res;
+	}
+}
@@ -0,0 +1,120 @@
+// Cell Reader class
+#pragma once
+
+#include "Cell.h"
+
+namespace HexagonCells
+{
+	class CMappedFile;
+
+	const char	CELL_FILE_MAGIC[4]	= { 'H', 'C', 'E', 'L' };	///< Signature of the cell file
+	const dword	CELL_FILE_VERSION	= 1;						///< Version of the cell file format
+	const dword	CELL_FILE_ADJACENCY	= 0x01;						///< The cell file contains the adjacency table
+
+	/**
+	@brief Header of the cell file
+	@details The cell file, written by @ref CCell::save(), consists of the header, followed by the cell values and optionally by the adjacency table.
+	All the values are native-endian, and all the arrays are 8-byte aligned, so the file may be memory-mapped and accessed without parsing:
+	- cell values: \a nCells x \a channels doubles in the format of @ref CCell::getVals(void), starting at \a valuesOffset
+	- adjacency table: \a nCells x 6 32-bit integers in the format of @ref CCell::getAdjacency(), starting at \a adjacencyOffset
+	*/
+	typedef struct {
+		char	magic[4];			///< CELL_FILE_MAGIC
+		dword	version;			///< CELL_FILE_VERSION
+		dword	width;				///< Image width
+		dword	height;				///< Image height
+		double	R;					///< Hexagon outer radius
+		double	r;					///< Hexagon inner radius
+		double	S;					///< Hexagon area in pixels
+		int		nCells;				///< Number of hexagons in the image
+		int		channels;			///< Number of the image channels
+		dword	cellIntApp;			///< Cell interpolation approach (Ref. @ref cell_int_app)
+		dword	flags;				///< CELL_FILE_ADJACENCY if the file contains the adjacency table
+		qword	valuesOffset;		///< Offset of the cell values in bytes
+		qword	adjacencyOffset;	///< Offset of the adjacency table in bytes (0 if not stored)
+	} cell_file_header;
+
+	// ================================ Cell Reader Class ================================
+	/**
+	@brief Cell reader class
+	@details This class memory-maps a cell file, written by @ref CCell::save(), and provides the same index-based queries as @ref CCell.
+	The cell values and the adjacency table are accessed directly in the mapped file, without parsing or copying. The look-up table,
+	needed by @ref getIDX(), is taken from the look-up table cache (Ref. @ref CLUTCache), as well as the adjacency table, if it is not stored
+	in the file.
+	*/
+	class CCellReader
+	{
+	public:
+		DllExport CCellReader(void);
+		DllExport ~CCellReader(void);
+
+		/**
+		@brief Opens the cell file
+		@param fileName The file name
+		@retval true on success
+		@retval false if the file can not be opened or is not a valid cell file
+		*/
+		DllExport bool			  open(const std::string &fileName);
+		/**
+		@brief Closes the cell file
+		*/
+		DllExport void			  close(void);
+
+		/**
+		@brief Returns the cell parameters
+		@return %cell_params structure (Ref. @ref cell_params)
+		*/
+		DllExport cell_params	  getInfo(void) const;
+		/**
+		@brief Returns the image size
+		*/
+		DllExport CvSize		  getSize(void) const { return m_imgSize; }
+		/**
+		@brief Returns the cell index (Ref. @ref CCell::getIDX())
+		@param x x-coordinate of a pixel in the image
+		@param y y-coordinate of a pixel in the image
+		@return Index of the cell, to which the pixel belongs
+		*/
+		DllExport int			  getIDX(int x, int y);
+		/**
+		@brief Returns the neighbouring cell index (Ref. @ref CCell::getNeighbourIDX())
+		@param idx Cell index
+		@param i Cell neighbour index in range from 0 till 5
+		@retval Index of the neighbouring cell
+		@retval -1 If the neighbour is beyond the image borders
+		*/
+		DllExport int			  getNeighbourIDX(int idx, int i);
+		/**
+		@brief Returns the adjacency table (Ref. @ref CCell::getAdjacency())
+		@return The adjacency table Mat(N, 6, CV_32SC1), where N is the number of cells
+		@warning The returned matrix may refer to the mapped file; it is valid until the file is closed and must not be modified
+		*/
+		DllExport Mat			  getAdjacency(void);
+		/**
+		@brief Returns the color of the specified cell
+		@param idx Cell index
+		@return Cell color (the first 4 channels)
+		*/
+		DllExport CvScalar		  getVal(int idx) const;
+		/**
+		@brief Returns the colors of all the cells (Ref. @ref CCell::getVals(void))
+		@return The cell colors Mat(1, N, CV_64FC(C))
+		@warning The returned matrix refers to the mapped file; it is valid until the file is closed and must not be modified
+		*/
+		DllExport Mat			  getVals(void) const { return m_vals; }
+
+
+	private:
+		CMappedFile			* m_pFile;		// NULL;			// The mapped cell file
+		CvSize				  m_imgSize;	// cvSize(0, 0);	// Image size
+		cell_params			  m_params;		//					// Cell parameters
+		Mat					  m_vals;		// Mat();			// Cell values in the mapped file
+		Mat					  m_adjacency;	// Mat();			// Adjacency table in the mapped file or calculated
+		CCell				  m_cell;		//					// Geometry of the grid (for the look-up table and the adjacency table)
+
+
+		// Copy semantics are disabled
+		CCellReader(const CCellReader &rhs) {}
+		const CCellReader & operator= (const CCellReader & rhs) { return *this; }
+	};
+}
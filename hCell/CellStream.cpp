@@ -0,0 +1,105 @@
+#include "CellStream.h"
+#include "Voter.h"
+#include "macroses.h"
+
+namespace HexagonCells
+{
+	// Constructor
+	CCellStream::CCellStream(CvSize imgSize, double R, cell_int_app cellIntApp) : m_imgSize(imgSize), m_R(R), m_cellIntApp(cellIntApp), m_C(-1), m_y(0), m_first(0), m_end(0)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((imgSize.height != 0) && (imgSize.width != 0), "The image size is not set");
+		HCELL_ASSERT_MSG(R >= MIN_RADIUS, "The cell radius is not set or has a wrong value");
+
+		m_vLUT.resize(imgSize.width);
+	}
+
+	void CCellStream::reset(void)
+	{
+		m_C		= -1;
+		m_y		= 0;
+		m_first = 0;
+		m_end	= 0;
+		m_vSum.clear();
+		m_vCount.clear();
+		m_vValues.clear();
+	}
+
+	Mat CCellStream::addStrip(const Mat &strip)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG(strip.cols == m_imgSize.width, "The strip width (%d) does not match the image width (%d)", strip.cols, m_imgSize.width);
+		HCELL_ASSERT_MSG(m_y + strip.rows <= m_imgSize.height, "The strips exceed the image height (%d)", m_imgSize.height);
+		HCELL_ASSERT_MSG((m_C < 0) || (strip.channels() == m_C), "The number of the strip channels (%d) does not match the previous strips (%d)", strip.channels(), m_C);
+
+		if (m_C < 0) m_C = strip.channels();
+		const int C = m_C;
+
+		for (int i = 0; i < strip.rows; i++, m_y++) {
+			strip.row(i).convertTo(m_row, CV_64F);				// all the pixel types are represented exactly
+			const double *pRow = m_row.ptr<double>(0);
+			const int	 *pLUT = m_vLUT.data();
+			CCell::calculateLUTRow(m_imgSize, m_R, m_y, m_vLUT.data());
+
+			for (int x0 = 0; x0 < m_imgSize.width; ) {
+				int x1 = x0 + 1;
+				while ((x1 < m_imgSize.width) && (pLUT[x1] == pLUT[x0])) x1++;
+
+				// span [x0; x1) of the cell pLUT[x0]
+				int id = pLUT[x0];
+				if (id >= m_end) {
+					m_end = id + 1;
+					m_vCount.resize(m_end - m_first, 0);
+					if (m_cellIntApp == CELL_MV) m_vValues.resize(m_end - m_first);
+					else						 m_vSum.resize(static_cast<size_t>(m_end - m_first) * C, 0);
+				}
+				m_vCount[id - m_first] += x1 - x0;
+				if (m_cellIntApp == CELL_MV) {
+					std::vector<double> &vValues = m_vValues[id - m_first];
+					vValues.insert(vValues.end(), pRow + C * x0, pRow + C * x1);
+				}
+				else {
+					double *pSum = &m_vSum[static_cast<size_t>(id - m_first) * C];
+					for (const double *pVal = pRow + C * x0; pVal < pRow + C * x1; pVal += C)
+						for (int c = 0; c < C; c++) pSum[c] += pVal[c];
+				}
+				x0 = x1;
+			} // x0
+		} // i
+
+		// The cells, which can not be touched by the next rows, are completed
+		int last = (m_y == m_imgSize.height) ? m_end : MIN(m_end, CCell::getMinIDX(m_imgSize, m_R, m_y));
+		return complete(last);
+	}
+
+	// =================== Private functions ===================
+	Mat CCellStream::complete(int last)
+	{
+		const int C = m_C;
+		const int n = MAX(0, last - m_first);
+		if (n == 0) return Mat();
+
+		Mat res(1, n, CV_64FC(C), Scalar::all(0));
+		double *pRes = res.ptr<double>(0);
+		if (m_cellIntApp == CELL_MV) {
+			CVoter<double> voter;
+			for (int i = 0; i < n; i++) {
+				const std::vector<double> &vValues = m_vValues[i];
+				if (vValues.empty()) continue;
+				for (int c = 0; c < C; c++) pRes[C * i + c] = voter.vote(vValues.data() + c, vValues.data() + vValues.size(), C);
+			}
+			m_vValues.erase(m_vValues.begin(), m_vValues.begin() + n);
+		}
+		else {
+			for (int i = 0; i < n; i++) {
+				if (m_vCount[i] == 0) continue;
+				for (int c = 0; c < C; c++) pRes[C * i + c] = m_vSum[static_cast<size_t>(C) * i + c] / m_vCount[i];
+			}
+			m_vSum.erase(m_vSum.begin(), m_vSum.begin() + static_cast<size_t>(n) * C);
+		}
+		m_vCount.erase(m_vCount.begin(), m_vCount.begin() + n);
+		m_first = last;
+
+		return res;
+	}
+}
@@ -0,0 +1,83 @@
+// Cell Stream class
+#pragma once
+
+#include "Cell.h"
+
+namespace HexagonCells
+{
+	// ================================ Cell Stream Class ================================
+	/**
+	@brief Cell stream class
+	@details This class calculates the cell colors of an image, which is given as a sequence of horizontal strips, \a e.g. read from a tiled
+	or a raw image file, which does not fit into memory. Neither the image nor its look-up table is stored: the look-up table is calculated
+	row by row, and only the cells, which may still receive pixels of the next strips, are kept. A cell is completed, as soon as no later
+	image row can touch it, thus the memory is bounded by a few rows of cells. The cells are completed in the order of their indexes.
+
+	The results are the same as of @ref CCell::getVal() for the whole image (for floating-point images the averages may differ in the last
+	bits due to the summation order):
+	@code
+	CCellStream stream(imgSize, R);
+	for (...) {
+		Mat vals = stream.addStrip(strip);					// the colors of the next vals.cols cells
+		...
+	}
+	@endcode
+	@note The per-cell statistics and the accelerated mode of @ref CCell are not supported
+	*/
+	class CCellStream
+	{
+	public:
+		/**
+		@brief Constuctor
+		@param imgSize The size of the whole image
+		@param R Hexagon outer radius
+		@param cellIntApp Cell interpolation approach (Ref. @ref cell_int_app)
+		*/
+		DllExport CCellStream(CvSize imgSize, double R, cell_int_app cellIntApp = CELL_AVG);
+		DllExport ~CCellStream(void) {}
+
+		/**
+		@brief Restarts the stream for a new image of the same size
+		*/
+		DllExport void	reset(void);
+		/**
+		@brief Adds the next strip of the image
+		@param strip The next rows of the image: Mat(h, imgSize.width, type), where h is arbitrary. All the strips must have the same type
+		@return The colors of the cells, completed by the strip, in the format of @ref CCell::getVals(void). The first returned cell follows
+		the last cell, returned by the previous call. After the last strip all the remaining cells are returned.
+		*/
+		DllExport Mat	addStrip(const Mat &strip);
+		/**
+		@brief Returns the number of the received image rows
+		*/
+		DllExport int	getNumRows(void) const { return m_y; }
+		/**
+		@brief Returns the number of the completed cells
+		*/
+		DllExport int	getNumCompleted(void) const { return m_first; }
+
+
+	private:
+		Mat				complete(int last);		// returns the colors of the cells [m_first; last) and removes them from the stream
+
+
+	private:
+		CvSize								m_imgSize;		//						// The size of the whole image
+		double								m_R;			//						// Hexagon outer radius
+		cell_int_app						m_cellIntApp;	//						// Cell interpolation approach
+		int									m_C;			// -1;					// Number of the image channels (-1 until the first strip)
+		int									m_y;			// 0;					// Index of the next image row
+		int									m_first;		// 0;					// Index of the first not completed cell
+		int									m_end;			// 0;					// Index of the last touched cell + 1
+		std::vector<int>					m_vLUT;			//						// Look-up table row
+		Mat									m_row;			// Mat();				// Image row Mat(1, width, CV_64FC(C))
+		std::vector<double>					m_vSum;			//						// Sums of the pixel values of the cells [m_first; m_end) (CELL_AVG)
+		std::vector<int>					m_vCount;		//						// Number of pixels of the cells [m_first; m_end)
+		std::vector<std::vector<double>>	m_vValues;		//						// Pixel values of the cells [m_first; m_end) in the raster order (CELL_MV)
+
+
+		// Copy semantics are disabled
+		CCellStream(const CCellStream &rhs) {}
+		const CCellStream & operator= (const CCellStream & rhs) { return *this; }
+	};
+}
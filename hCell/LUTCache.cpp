@@ -0,0 +1,217 @@
+#include "LUTCache.h"
+#include "MappedFile.h"
+#include "Cell.h"
+#include "macroses.h"
+#include <atomic>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace HexagonCells
+{
+	namespace {
+		const char	LUT_FILE_MAGIC[4]	= { 'H', 'L', 'U', 'T' };
+		const dword	LUT_FILE_VERSION	= 2;
+
+		// Header of the look-up table file; it is followed by the height + 1 row span offsets and the nSpans spans (Ref. lut_data),
+		// all the values are native-endian 32-bit integers
+		typedef struct {
+			char	magic[4];		// LUT_FILE_MAGIC
+			dword	version;		// LUT_FILE_VERSION
+			dword	width;			// Image width
+			dword	height;			// Image height
+			double	R;				// Hexagon outer radius
+			int		nCells;			// Number of hexagons in the image
+			int		nSpans;			// Number of spans in the image
+		} lut_file_header;
+
+		// Checks the span index of a loaded table: every row starts at x = 0, its spans have increasing x-coordinates and valid cell
+		// indexes, and the row is closed by the terminator {width, -1}, on which the binary search of CCell relies
+		bool isValid(const lut_data &lut, int width)
+		{
+			const int		  height	= lut.rowSpans.cols - 1;
+			const int		* pRowSpans = lut.rowSpans.ptr<int>(0);
+			const cell_span	* pSpans	= lut.spans.ptr<cell_span>(0);
+			if ((lut.nCells <= 0) || (pRowSpans[0] != 0) || (pRowSpans[height] != lut.spans.cols)) return false;
+			for (int y = 0; y < height; y++) {
+				const int first = pRowSpans[y];
+				const int last	= pRowSpans[y + 1] - 1;						// the terminator
+				if (last <= first) return false;
+				if ((pSpans[first].x != 0) || (pSpans[last].x != width) || (pSpans[last].idx != -1)) return false;
+				for (int k = first; k < last; k++)
+					if ((pSpans[k + 1].x <= pSpans[k].x) || (pSpans[k].idx < 0) || (pSpans[k].idx >= lut.nCells)) return false;
+			}
+			return true;
+		}
+	}
+
+	// Constructor
+	CLUTCache::CLUTCache(void) : m_size(0), m_budget(256 << 20), m_storage("")
+	{
+	}
+
+	CLUTCache & CLUTCache::getInstance(void)
+	{
+		static CLUTCache instance;
+		return instance;
+	}
+
+	ptr_lut_t CLUTCache::get(CvSize imgSize, double R)
+	{
+		// Assertions
+		HCELL_ASSERT_MSG((imgSize.height != 0) && (imgSize.width != 0), "The image size is not set");
+		HCELL_ASSERT_MSG(R > 0, "The cell radius is not set or has a wrong value");
+
+		key_t key(std::make_pair(imgSize.width, imgSize.height), R);
+
+		ptr_lut_t res = find(key);
+		if (res) return res;
+
+		std::string fileName;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_storage.empty()) fileName = getFileName(key);
+		}
+
+		if (!fileName.empty()) res = load(key, fileName);
+		if (!res) {
+			res = CCell::buildLUT(imgSize, R);
+			if (!fileName.empty()) save(*res, key, fileName);
+		}
+
+		return insert(key, res);
+	}
+
+	void CLUTCache::setMemoryBudget(size_t budget)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_budget = budget;
+		shrink();
+	}
+
+	void CLUTCache::setStorage(const std::string &path)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_storage = path;
+	}
+
+	void CLUTCache::clear(void)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_mEntries.clear();
+		m_lEntries.clear();
+		m_size = 0;
+	}
+
+	// =================== Private functions ===================
+	ptr_lut_t CLUTCache::find(const key_t &key)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<key_t, std::list<entry_t>::iterator>::iterator it = m_mEntries.find(key);
+		if (it == m_mEntries.end()) return ptr_lut_t();
+		m_lEntries.splice(m_lEntries.begin(), m_lEntries, it->second);		// mark as the most recently used
+		return it->second->second;
+	}
+
+	ptr_lut_t CLUTCache::insert(const key_t &key, ptr_lut_t pLUT)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<key_t, std::list<entry_t>::iterator>::iterator it = m_mEntries.find(key);
+		if (it != m_mEntries.end()) {														// the table was inserted by another thread meanwhile
+			m_lEntries.splice(m_lEntries.begin(), m_lEntries, it->second);
+			return it->second->second;
+		}
+		m_lEntries.push_front(entry_t(key, pLUT));
+		m_mEntries[key] = m_lEntries.begin();
+		m_size += getSize(*pLUT);
+		shrink();
+		return pLUT;
+	}
+
+	void CLUTCache::shrink(void)
+	{
+		while ((m_size > m_budget) && (m_lEntries.size() > 1)) {							// the most recently used table is always kept
+			const entry_t &entry = m_lEntries.back();
+			m_size -= getSize(*entry.second);
+			m_mEntries.erase(entry.first);
+			m_lEntries.pop_back();
+		}
+	}
+
+	std::string CLUTCache::getFileName(const key_t &key) const
+	{
+		qword bits;
+		memcpy(&bits, &key.second, sizeof(bits));											// R is encoded exactly
+		char name[64];
+		sprintf(name, "lut_%dx%d_%016llx.hlut", key.first.first, key.first.second, static_cast<unsigned long long>(bits));
+		return m_storage + "/" + name;
+	}
+
+	ptr_lut_t CLUTCache::load(const key_t &key, const std::string &fileName)
+	{
+		std::shared_ptr<CMappedFile> pFile = std::make_shared<CMappedFile>();
+		if (!pFile->open(fileName)) return ptr_lut_t();
+
+		int		width  = key.first.first;
+		int		height = key.first.second;
+		if (pFile->size() < sizeof(lut_file_header)) return ptr_lut_t();
+
+		lut_file_header header;
+		memcpy(&header, pFile->data(), sizeof(header));
+		if (memcmp(header.magic, LUT_FILE_MAGIC, sizeof(header.magic)) != 0) return ptr_lut_t();
+		if (header.version != LUT_FILE_VERSION) return ptr_lut_t();
+		if ((header.width != static_cast<dword>(width)) || (header.height != static_cast<dword>(height)) || (header.R != key.second)) return ptr_lut_t();
+		size_t size = sizeof(header) + (static_cast<size_t>(height) + 1) * sizeof(int) + static_cast<size_t>(header.nSpans) * sizeof(cell_span);
+		if ((header.nSpans < height) || (pFile->size() != size)) return ptr_lut_t();
+
+		byte *pData = const_cast<byte *>(pFile->data() + sizeof(header));
+		std::shared_ptr<lut_data> pLUT = std::make_shared<lut_data>();
+		pLUT->rowSpans = Mat(1, height + 1, CV_32SC1, pData);
+		pLUT->spans	   = Mat(1, header.nSpans, CV_32SC2, pData + (height + 1) * sizeof(int));
+		pLUT->nCells   = header.nCells;
+		if (!isValid(*pLUT, width)) {
+			HCELL_WARNING("The look-up table file \"%s\" is damaged", fileName.c_str());
+			return ptr_lut_t();
+		}
+		pLUT->storage = pFile;
+		return pLUT;
+	}
+
+	void CLUTCache::save(const lut_data &lut, const key_t &key, const std::string &fileName)
+	{
+		lut_file_header header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, LUT_FILE_MAGIC, sizeof(header.magic));
+		header.version	= LUT_FILE_VERSION;
+		header.width	= static_cast<dword>(key.first.first);
+		header.height	= static_cast<dword>(key.first.second);
+		header.R		= key.second;
+		header.nCells	= lut.nCells;
+		header.nSpans	= lut.spans.cols;
+
+		// The table is written to a temporary file first, so a concurrent process never maps an incomplete file; the name of the
+		// temporary file is unique for every process and call, so concurrent writers of the same table never share it
+		static std::atomic<unsigned int> counter(0);
+		char suffix[64];
+		sprintf(suffix, ".%d.%u.tmp", static_cast<int>(getpid()), counter++);
+		std::string tmpFileName = fileName + suffix;
+		FILE *pFile = fopen(tmpFileName.c_str(), "wb");
+		if (pFile == NULL) {
+			HCELL_WARNING("Can not write the look-up table to \"%s\"", tmpFileName.c_str());
+			return;
+		}
+		bool res = fwrite(&header, sizeof(header), 1, pFile) == 1;
+		res &= fwrite(lut.rowSpans.ptr<int>(0), sizeof(int), lut.rowSpans.cols, pFile) == static_cast<size_t>(lut.rowSpans.cols);
+		res &= fwrite(lut.spans.ptr<cell_span>(0), sizeof(cell_span), lut.spans.cols, pFile) == static_cast<size_t>(lut.spans.cols);
+		res &= fclose(pFile) == 0;
+		if (!res || (rename(tmpFileName.c_str(), fileName.c_str()) != 0)) remove(tmpFileName.c_str());
+	}
+
+	size_t CLUTCache::getSize(const lut_data &lut)
+	{
+		return lut.spans.total() * lut.spans.elemSize() + lut.rowSpans.total() * lut.rowSpans.elemSize();
+	}
+}
@@ -0,0 +1,116 @@
+// LUT Cache class
+#pragma once
+
+#include "types.h"
+#include <memory>
+#include <mutex>
+#include <list>
+#include <map>
+
+namespace HexagonCells
+{
+	///@brief Cell span structure: a run of pixels in an image row, which belong to the same cell
+	typedef struct {
+		int		x;		///< x-coordinate of the first pixel of the span
+		int		idx;	///< Cell index (-1 for the terminating span of a row)
+	} cell_span;
+
+	/**
+	@brief Look-up table structure
+	@details The look-up table is stored as a per-row span index: every image row is a sequence of spans, terminated with the span
+	{width, -1}, thus the span \a k ends before the first pixel of the span \a k + 1. The spans of the row \a y are the elements
+	[rowSpans[y]; rowSpans[y + 1] - 1) of the spans array:
+	@code
+	const cell_span *pSpans	   = lut.spans.ptr<cell_span>(0);
+	const int		*pRowSpans = lut.rowSpans.ptr<int>(0);
+	for (int k = pRowSpans[y]; k < pRowSpans[y + 1] - 1; k++)
+		for (int x = pSpans[k].x; x < pSpans[k + 1].x; x++) ...		// pixel (x, y) belongs to the cell pSpans[k].idx
+	@endcode
+	*/
+	typedef struct {
+		Mat						spans;		///< Spans of all the rows Mat(1, nSpans, CV_32SC2) of cell_span
+		Mat						rowSpans;	///< Index of the first span of every row Mat(1, imgSize.height + 1, CV_32SC1)
+		int						nCells;		///< Number of hexagons in the image
+		std::shared_ptr<void>	storage;	///< Keeps the memory-mapped file with the look-up table data alive (may be empty)
+	} lut_data;
+
+	typedef std::shared_ptr<const lut_data>	ptr_lut_t;
+
+	// ================================ LUT Cache Class ================================
+	/**
+	@brief Process-wide cache of the look-up tables
+	@details The look-up tables depend only on the image size and the hexagon outer radius. This thread-safe cache shares one immutable
+	look-up table between all the CCell instances with the same parameters. The least recently used tables are evicted, when the total
+	size of the cached tables exceeds the memory budget. The tables, which are still in use by CCell instances, are kept alive by them.
+
+	Optionally, the look-up tables may be persisted in a storage directory: on a cache miss, the table is memory-mapped from the
+	corresponding file, if it exists, otherwise the table is calculated and written to the storage.
+	*/
+	class CLUTCache
+	{
+	public:
+		/**
+		@brief Returns the process-wide cache instance
+		*/
+		DllExport static CLUTCache	& getInstance(void);
+
+		/**
+		@brief Returns the look-up table
+		@details The table is taken from the cache, loaded from the storage or calculated, in this order
+		@param imgSize The image size
+		@param R Hexagon outer radius
+		@return The shared look-up table
+		*/
+		DllExport ptr_lut_t		get(CvSize imgSize, double R);
+		/**
+		@brief Sets the memory budget
+		@param budget Maximal total size of the cached look-up tables in bytes (default 256 Mb)
+		*/
+		DllExport void			setMemoryBudget(size_t budget);
+		/**
+		@brief Returns the memory budget
+		@return Maximal total size of the cached look-up tables in bytes
+		*/
+		DllExport size_t		getMemoryBudget(void) const { return m_budget; }
+		/**
+		@brief Sets the on-disk storage of the look-up tables
+		@param path Path to an existing directory; an empty string disables the storage (default)
+		*/
+		DllExport void			setStorage(const std::string &path);
+		/**
+		@brief Removes all the look-up tables from the cache
+		@note The files in the storage are not removed
+		*/
+		DllExport void			clear(void);
+
+
+	private:
+		typedef std::pair<std::pair<int, int>, double>	key_t;		// (width, height), R
+		typedef std::pair<key_t, ptr_lut_t>				entry_t;
+
+		CLUTCache(void);
+		~CLUTCache(void) {}
+
+		ptr_lut_t		find(const key_t &key);					// NULL if not in the cache
+		ptr_lut_t		insert(const key_t &key, ptr_lut_t pLUT);	// returns the cached table (which may be the one, inserted by another thread)
+		void			shrink(void);							// evicts the least recently used tables over the budget
+		std::string		getFileName(const key_t &key) const;
+		static ptr_lut_t load(const key_t &key, const std::string &fileName);				// NULL if the table is not in the storage
+		static void		save(const lut_data &lut, const key_t &key, const std::string &fileName);
+		static size_t	getSize(const lut_data &lut);
+
+
+	private:
+		std::mutex										m_mutex;
+		std::list<entry_t>								m_lEntries;		// Cached tables, the most recently used first
+		std::map<key_t, std::list<entry_t>::iterator>	m_mEntries;		// Fast access to the cached tables
+		size_t											m_size;			// 0;					// Total size of the cached tables in bytes
+		size_t											m_budget;		// 256 Mb;				// Memory budget in bytes
+		std::string										m_storage;		// "";					// Path to the on-disk storage
+
+
+		// Copy semantics are disabled
+		CLUTCache(const CLUTCache &rhs) {}
+		const CLUTCache & operator= (const CLUTCache & rhs) { return *this; }
+	};
+}
@@ -0,0 +1,92 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace HexagonCells
+{
+#ifdef _WIN32
+	// Constructor
+	CMappedFile::CMappedFile(void) : m_pData(NULL), m_size(0), m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL)
+	{
+	}
+#else
+	// Constructor
+	CMappedFile::CMappedFile(void) : m_pData(NULL), m_size(0), m_fd(-1)
+	{
+	}
+#endif
+
+	// Destructor
+	CMappedFile::~CMappedFile(void)
+	{
+		close();
+	}
+
+#ifdef _WIN32
+	bool CMappedFile::open(const std::string &fileName)
+	{
+		close();
+
+		m_hFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_hFile == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0) { close(); return false; }
+
+		m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_hMapping == NULL) { close(); return false; }
+
+		m_pData = static_cast<const byte *>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+		if (m_pData == NULL) { close(); return false; }
+		m_size = static_cast<size_t>(size.QuadPart);
+
+		return true;
+	}
+
+	void CMappedFile::close(void)
+	{
+		if (m_pData != NULL) UnmapViewOfFile(m_pData);
+		if (m_hMapping != NULL) CloseHandle(m_hMapping);
+		if (m_hFile != INVALID_HANDLE_VALUE) CloseHandle(m_hFile);
+		m_pData		= NULL;
+		m_size		= 0;
+		m_hMapping	= NULL;
+		m_hFile		= INVALID_HANDLE_VALUE;
+	}
+#else
+	bool CMappedFile::open(const std::string &fileName)
+	{
+		close();
+
+		m_fd = ::open(fileName.c_str(), O_RDONLY);
+		if (m_fd < 0) return false;
+
+		struct stat st;
+		if (fstat(m_fd, &st) != 0 || st.st_size == 0) { close(); return false; }
+
+		void *pData = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, m_fd, 0);
+		if (pData == MAP_FAILED) { close(); return false; }
+		m_pData = static_cast<const byte *>(pData);
+		m_size	= static_cast<size_t>(st.st_size);
+
+		return true;
+	}
+
+	void CMappedFile::close(void)
+	{
+		if (m_pData != NULL) munmap(const_cast<byte *>(m_pData), m_size);
+		if (m_fd >= 0) ::close(m_fd);
+		m_pData = NULL;
+		m_size	= 0;
+		m_fd	= -1;
+	}
+#endif
+}
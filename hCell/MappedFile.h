@@ -0,0 +1,55 @@
+// Memory-Mapped File class
+#pragma once
+
+#include "types.h"
+
+namespace HexagonCells
+{
+	// ================================ Mapped File Class ================================
+	/**
+	@brief Read-only memory-mapped file
+	@details The file content is accessible via data() as long as the object exists and is open
+	*/
+	class CMappedFile
+	{
+	public:
+		CMappedFile(void);
+		~CMappedFile(void);
+
+		/**
+		@brief Maps the file into the memory
+		@param fileName The file name
+		@retval true on success
+		@retval false if the file does not exist or can not be mapped
+		*/
+		bool			open(const std::string &fileName);
+		/**
+		@brief Unmaps the file
+		*/
+		void			close(void);
+		/**
+		@brief Returns the pointer to the mapped file content
+		*/
+		const byte	  * data(void) const { return m_pData; }
+		/**
+		@brief Returns the size of the mapped file content in bytes
+		*/
+		size_t			size(void) const { return m_size; }
+
+
+	private:
+		const byte	  * m_pData;	// NULL;		// The mapped file content
+		size_t			m_size;		// 0;			// Size of the file in bytes
+#ifdef _WIN32
+		void		  * m_hFile;	// INVALID_HANDLE_VALUE;
+		void		  * m_hMapping;	// NULL;
+#else
+		int				m_fd;		// -1;
+#endif
+
+
+		// Copy semantics are disabled
+		CMappedFile(const CMappedFile &rhs) {}
+		const CMappedFile & operator= (const CMappedFile & rhs) { return *this; }
+	};
+}
@@ -1,9 +1,247 @@
 #include "Marker.h"
 #include "Cell.h"
+#include "macroses.h"
 
 namespace HexagonCells
 {
-	void CMarker::markGrid(Mat &img, double R, CvScalar color)
+	namespace {
+		// Parallel drawing of the cells (over the image rows)
+		class CDrawBody : public ParallelLoopBody
+		{
+		public:
+			CDrawBody(Mat &img, const lut_data &lut, const Mat &palette) : m_img(img), m_lut(lut), m_palette(palette) {}
+
+			virtual void operator()(const Range &range) const
+			{
+				switch (m_img.elemSize()) {
+					case 1:	 draw<byte>(range);	break;
+					case 3:	 draw<Vec3b>(range); break;
+					case 4:	 draw<dword>(range); break;
+					default: draw(range);		break;
+				}
+			}
+
+		private:
+			template <typename T>
+			void draw(const Range &range) const
+			{
+				const T			* pPalette	= m_palette.ptr<T>(0);
+				const cell_span	* pSpans	= m_lut.spans.ptr<cell_span>(0);
+				const int		* pRowSpans	= m_lut.rowSpans.ptr<int>(0);
+				for (int y = range.start; y < range.end; y++) {
+					T *pImg = m_img.ptr<T>(y);
+					for (int k = pRowSpans[y]; k < pRowSpans[y + 1] - 1; k++) {
+						const T color = pPalette[pSpans[k].idx];
+						for (int x = pSpans[k].x; x < pSpans[k + 1].x; x++) pImg[x] = color;
+					}
+				}
+			}
+
+			void draw(const Range &range) const
+			{
+				const size_t	  es		= m_img.elemSize();
+				const byte		* pPalette	= m_palette.ptr<byte>(0);
+				const cell_span	* pSpans	= m_lut.spans.ptr<cell_span>(0);
+				const int		* pRowSpans	= m_lut.rowSpans.ptr<int>(0);
+				for (int y = range.start; y < range.end; y++) {
+					byte *pImg = m_img.ptr<byte>(y);
+					for (int k = pRowSpans[y]; k < pRowSpans[y + 1] - 1; k++)
+						for (int x = pSpans[k].x; x < pSpans[k + 1].x; x++) memcpy(pImg + es * x, pPalette + es * pSpans[k].idx, es);
+				}
+			}
+
+		private:
+			Mat				&m_img;
+			const lut_data	&m_lut;
+			const Mat		&m_palette;
+		};
+
+		// Alpha-blending of the grid color (over the image rows): dst = (dst * (255 - a) + color * a) / 255
+		// The mask has the same number of channels as the image, thus every row is blended as a flat array of bytes
+		class CBlendBody : public ParallelLoopBody
+		{
+		public:
+			CBlendBody(Mat &img, const Mat &mask, CvScalar color) : m_img(img), m_mask(mask), m_color(color) {}
+
+			virtual void operator()(const Range &range) const
+			{
+				if (m_img.depth() == CV_8U) blend_8u(range);
+				else blend(range);
+			}
+
+		private:
+			// Rounded division by 255 for x in [0; 255 * 255]
+			static inline int div255(int x) { x += 128; return (x + (x >> 8)) >> 8; }
+
+			void blend_8u(const Range &range) const
+			{
+				const int C		= m_img.channels();
+				const int width = m_img.cols * C;
+
+				// One row of the grid color; the pattern is replicated, so the color of every byte is found at the same position
+				std::vector<byte> vColor(width);
+				for (int i = 0; i < width; i++) vColor[i] = saturate_cast<byte>(m_color.val[i % C]);
+
+#ifdef ENABLE_AVX2
+				const bool avx2 = checkHardwareSupport(CV_CPU_AVX2);
+#endif
+				for (int y = range.start; y < range.end; y++) {
+					byte		*pImg  = m_img.ptr<byte>(y);
+					const byte	*pMask = m_mask.ptr<byte>(y);
+					const byte	*pCol  = vColor.data();
+					int			 i	   = 0;
+#ifdef ENABLE_AVX2
+					if (avx2) {
+						const __m256i c128 = _mm256_set1_epi16(128);
+						const __m256i c255 = _mm256_set1_epi16(255);
+						for (; i + 16 <= width; i += 16) {
+							__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pMask + i)));
+							__m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pImg + i)));
+							__m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pCol + i)));
+							__m256i x = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(v, _mm256_sub_epi16(c255, a)), _mm256_mullo_epi16(c, a)), c128);
+							x = _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+							__m128i res = _mm_packus_epi16(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+							_mm_storeu_si128(reinterpret_cast<__m128i *>(pImg + i), res);
+						}
+					}
+#endif
+					for (; i < width; i++) pImg[i] = static_cast<byte>(div255(pImg[i] * (255 - pMask[i]) + pCol[i] * pMask[i]));
+				} // y
+			}
+
+			void blend(const Range &range) const
+			{
+				const int C = m_img.channels();
+				Mat row;
+				for (int y = range.start; y < range.end; y++) {
+					m_img.row(y).convertTo(row, CV_64F);
+					double		*pRow  = row.ptr<double>(0);
+					const byte	*pMask = m_mask.ptr<byte>(y);
+					for (int i = 0; i < m_img.cols * C; i++) {
+						double a = pMask[i] / 255.0;
+						pRow[i] = (1 - a) * pRow[i] + a * m_color.val[i % C];
+					}
+					Mat dst = m_img.row(y);
+					row.convertTo(dst, m_img.depth());
+				} // y
+			}
+
+		private:
+			Mat			&m_img;
+			const Mat	&m_mask;
+			CvScalar	 m_color;
+		};
+
+		// Barycentric interpolation of the cell colors (over the image rows): dst = w0 * palette[i0] + w1 * palette[i1] + w2 * palette[i2]
+		// Every row is gathered into a floating-point buffer and converted to the image depth
+		class CInterpolationBody : public ParallelLoopBody
+		{
+		public:
+			CInterpolationBody(Mat &img, const vec_mat_t &vTriangles, const Mat &palette) : m_img(img), m_vTriangles(vTriangles), m_palette(palette) {}
+
+			virtual void operator()(const Range &range) const
+			{
+				const int	  C		   = m_img.channels();
+				const int	  width	   = m_img.cols;
+				const float	* pPalette = m_palette.ptr<float>(0);
+				Mat			  row(1, width, CV_32FC(C));
+
+#ifdef ENABLE_AVX2
+				const bool avx2 = checkHardwareSupport(CV_CPU_AVX2);
+#endif
+				for (int y = range.start; y < range.end; y++) {
+					const int	*pIdx0 = m_vTriangles[0].ptr<int>(y);
+					const int	*pIdx1 = m_vTriangles[1].ptr<int>(y);
+					const int	*pIdx2 = m_vTriangles[2].ptr<int>(y);
+					const float	*pW0   = m_vTriangles[3].ptr<float>(y);
+					const float	*pW1   = m_vTriangles[4].ptr<float>(y);
+					const float	*pW2   = m_vTriangles[5].ptr<float>(y);
+					float		*pRow  = row.ptr<float>(0);
+					int			 x	   = 0;
+#ifdef ENABLE_AVX2
+					if (avx2) {
+						const __m256i vC = _mm256_set1_epi32(C);
+						float tmp[8];
+						for (; x + 8 <= width; x += 8) {
+							__m256i i0 = _mm256_mullo_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(pIdx0 + x)), vC);
+							__m256i i1 = _mm256_mullo_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(pIdx1 + x)), vC);
+							__m256i i2 = _mm256_mullo_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(pIdx2 + x)), vC);
+							__m256	w0 = _mm256_loadu_ps(pW0 + x);
+							__m256	w1 = _mm256_loadu_ps(pW1 + x);
+							__m256	w2 = _mm256_loadu_ps(pW2 + x);
+							for (int c = 0; c < C; c++) {
+								__m256 v = _mm256_mul_ps(w0, _mm256_i32gather_ps(pPalette + c, i0, 4));
+								v = _mm256_add_ps(v, _mm256_mul_ps(w1, _mm256_i32gather_ps(pPalette + c, i1, 4)));
+								v = _mm256_add_ps(v, _mm256_mul_ps(w2, _mm256_i32gather_ps(pPalette + c, i2, 4)));
+								if (C == 1) _mm256_storeu_ps(pRow + x, v);
+								else {
+									_mm256_storeu_ps(tmp, v);
+									for (int k = 0; k < 8; k++) pRow[C * (x + k) + c] = tmp[k];
+								}
+							} // c
+						} // x
+					}
+#endif
+					for (; x < width; x++) {
+						const float *pV0 = pPalette + C * pIdx0[x];
+						const float *pV1 = pPalette + C * pIdx1[x];
+						const float *pV2 = pPalette + C * pIdx2[x];
+						for (int c = 0; c < C; c++) pRow[C * x + c] = pW0[x] * pV0[c] + pW1[x] * pV1[c] + pW2[x] * pV2[c];
+					} // x
+					if (m_img.depth() == CV_8U) store_8u(pRow, m_img.ptr<byte>(y), C * width);
+					else {
+						Mat dst = m_img.row(y);
+						row.convertTo(dst, m_img.depth());
+					}
+				} // y
+			}
+
+		private:
+			// Rounding and saturation of a row of floats to bytes
+			static void store_8u(const float *pSrc, byte *pDst, int n)
+			{
+				int i = 0;
+#ifdef ENABLE_AVX2
+				if (checkHardwareSupport(CV_CPU_AVX2))
+					for (; i + 16 <= n; i += 16) {
+						__m256i a = _mm256_cvtps_epi32(_mm256_loadu_ps(pSrc + i));
+						__m256i b = _mm256_cvtps_epi32(_mm256_loadu_ps(pSrc + i + 8));
+						__m256i x = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+						__m128i res = _mm_packus_epi16(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+						_mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + i), res);
+					}
+#endif
+				for (; i < n; i++) pDst[i] = saturate_cast<byte>(pSrc[i]);
+			}
+
+		private:
+			Mat				&m_img;
+			const vec_mat_t	&m_vTriangles;
+			const Mat		&m_palette;
+		};
+	}
+
+	void CMarker::markGrid(Mat &img, double R, CvScalar color, int thickness)
+	{
+		if (img.channels() == 1) cvtColor(img, img, CV_GRAY2RGB);
+
+		const int C = img.channels();
+
+		// Assertions
+		HCELL_ASSERT_MSG(C <= 4, "Images with %d channels are not supported", C);
+
+		grid_key_t key(std::make_pair(std::make_pair(img.cols, img.rows), R), std::make_pair(thickness, C));
+		Mat &mask = m_mGrid[key];
+		if (mask.empty()) {
+			Mat grid(img.size(), CV_8UC1, Scalar(0));
+			drawGrid(grid, R, cvScalarAll(255), thickness);
+			merge(vec_mat_t(C, grid), mask);
+		}
+
+		parallel_for_(Range(0, img.rows), CBlendBody(img, mask, color));
+	}
+
+	void CMarker::drawGrid(Mat &img, double R, CvScalar color, int thickness)
 	{
 		int x, y;
 		double X, Y;
@@ -16,8 +254,6 @@ namespace HexagonCells
 
 		//printf("S = %.2f (pixels);\n", S);
 
-		if (img.channels() == 1) cvtColor(img, img, CV_GRAY2RGB);
-
 		X = 0; Y = 0;
 		for (y = 0; Y < img.rows; y++) {
 			if (y % 2 == 0)	X0 = r;
@@ -28,12 +264,12 @@ namespace HexagonCells
 				Y = R / 2 + y * dy;
 				//circle(img, cvPoint(static_cast<int>(X), static_cast<int>(Y)), 1, color);
 
-				line(img, Point2d(X, Y - R), Point2d(X + r, Y - (R / 2)), color, 1, CV_AA);
-				line(img, Point2d(X + r, Y - (R / 2)), Point2d(X + r, Y + (R / 2)), color, 1, CV_AA);
-				line(img, Point2d(X, Y + R), Point2d(X + r, Y + (R / 2)), color, 1, CV_AA);
+				line(img, Point2d(X, Y - R), Point2d(X + r, Y - (R / 2)), color, thickness, CV_AA);
+				line(img, Point2d(X + r, Y - (R / 2)), Point2d(X + r, Y + (R / 2)), color, thickness, CV_AA);
+				line(img, Point2d(X, Y + R), Point2d(X + r, Y + (R / 2)), color, thickness, CV_AA);
 			} // x
 		} // y
-		rectangle(img, Point(0, 0), Point(img.cols - 1, img.rows - 1), color, 1);
+		rectangle(img, Point(0, 0), Point(img.cols - 1, img.rows - 1), color, thickness);
 	}
 
 	void CMarker::markHexagon(Mat &img, double R, int idx, CvScalar color)
@@ -54,4 +290,125 @@ namespace HexagonCells
 		int npt[] = { 6 };
 		fillPoly(img, countours, npt, 1, color);
 	}
+
+	void CMarker::markHexagons(Mat &img, CCell &cell)
+	{
+		Mat		cellData = cell.getVals();
+		CvSize	size	 = cell.m_imgSize;
+		int		C		 = cellData.channels();
+
+		if ((img.empty()) || (img.size() != Size(size))) img.create(size, CV_8UC(C));
+		int		dstC	 = img.channels();
+
+		// Assertions
+		HCELL_ASSERT_MSG((dstC == C) || (dstC == 1 && C >= 3) || (C == 1), "The number of image channels (%d) does not match the number of cell channels (%d)", dstC, C);
+
+		// The cell colors in the image format
+		Mat palette = getPalette(cellData, dstC, img.depth());
+
+		parallel_for_(Range(0, img.rows), CDrawBody(img, *cell.m_pLUT, palette));
+	}
+
+	void CMarker::reconstruct(Mat &img, CCell &cell)
+	{
+		Mat		cellData = cell.getVals();
+		CvSize	size	 = cell.m_imgSize;
+		int		C		 = cellData.channels();
+
+		if ((img.empty()) || (img.size() != Size(size))) img.create(size, CV_8UC(C));
+		int		dstC	 = img.channels();
+
+		// Assertions
+		HCELL_ASSERT_MSG((dstC == C) || (dstC == 1 && C >= 3) || (C == 1), "The number of image channels (%d) does not match the number of cell channels (%d)", dstC, C);
+
+		tri_key_t key(std::make_pair(size.width, size.height), cell.m_R);
+		vec_mat_t &vTriangles = m_mTriangles[key];
+		if (vTriangles.empty()) calculateTriangles(size, cell.m_R, cell.getInfo().N, vTriangles);
+
+		// The cell colors in the image format
+		Mat palette = getPalette(cellData, dstC, CV_32F);
+
+		parallel_for_(Range(0, img.rows), CInterpolationBody(img, vTriangles, palette));
+	}
+
+	// The cell centres form a triangular lattice: the centres of the cell row j lie at y = 0.5R + j * dy and, in units of r, at the odd
+	// x-coordinates for the even rows and at the even x-coordinates for the odd rows. In the strip between two cell rows the vertical
+	// lines through the centres cut the triangles into halves, thus the triangle of a pixel is found from its strip and half-column
+	void CMarker::calculateTriangles(CvSize imgSize, double R, int nCells, vec_mat_t &vTriangles)
+	{
+		double	r = 0.5 * sqrt(3.0) * R;
+		double	dy = 1.5 * R;
+		int		width0, width1;
+		CCell::getRowWidths(imgSize, R, width0, width1);
+		int		widthD = width0 + width1;
+		int		nRows  = CCell::idx2h(nCells - 1, R, imgSize).y + 1;
+
+		// Index of the cell at the half-column h of the cell row j; the lattice is clamped to the border cells
+		auto getIdx = [&](int j, int h) {
+			int width = (j % 2 == 0) ? width0 : width1;
+			int i	  = (h - (1 - j % 2)) >> 1;
+			i = MIN(MAX(i, 0), width - 1);
+			int idx = (j / 2) * widthD + ((j % 2 == 0) ? 0 : width0) + i;
+			return MIN(idx, nCells - 1);
+		};
+
+		vTriangles.resize(6);
+		for (int k = 0; k < 3; k++) vTriangles[k].create(imgSize, CV_32SC1);
+		for (int k = 3; k < 6; k++) vTriangles[k].create(imgSize, CV_32FC1);
+
+		for (int y = 0; y < imgSize.height; y++) {
+			// the strip between the cell rows j0 and j0 + 1; t is the relative distance to the row j0
+			double	v  = MIN(MAX((y - 0.5 * R) / dy, 0.0), static_cast<double>(nRows - 1));
+			int		j0 = MIN(static_cast<int>(v), MAX(nRows - 2, 0));
+			int		j1 = MIN(j0 + 1, nRows - 1);
+			float	t  = static_cast<float>(v - j0);
+
+			int		*pIdx0 = vTriangles[0].ptr<int>(y);
+			int		*pIdx1 = vTriangles[1].ptr<int>(y);
+			int		*pIdx2 = vTriangles[2].ptr<int>(y);
+			float	*pW0   = vTriangles[3].ptr<float>(y);
+			float	*pW1   = vTriangles[4].ptr<float>(y);
+			float	*pW2   = vTriangles[5].ptr<float>(y);
+			for (int x = 0; x < imgSize.width; x++) {
+				double	hf = x / r;
+				int		h0 = static_cast<int>(hf);
+				// hL is the half-column of the row j0 centre among h0 and h0 + 1, d points to the other one and f is the distance to hL
+				bool	lower = ((h0 + j0) % 2) == 1;
+				int		hL	  = lower ? h0 : h0 + 1;
+				int		d	  = lower ? 1 : -1;
+				float	f	  = static_cast<float>(lower ? hf - h0 : h0 + 1 - hf);
+
+				if (t <= f) {		// the triangle with two vertices in the row j0
+					pIdx0[x] = getIdx(j0, hL);			pW0[x] = 1 - 0.5f * (f + t);
+					pIdx1[x] = getIdx(j0, hL + 2 * d);	pW1[x] = 0.5f * (f - t);
+					pIdx2[x] = getIdx(j1, hL + d);		pW2[x] = t;
+				}
+				else {				// the triangle with two vertices in the row j0 + 1
+					pIdx0[x] = getIdx(j0, hL);			pW0[x] = 1 - t;
+					pIdx1[x] = getIdx(j1, hL + d);		pW1[x] = 0.5f * (t + f);
+					pIdx2[x] = getIdx(j1, hL - d);		pW2[x] = 0.5f * (t - f);
+				}
+			} // x
+		} // y
+	}
+
+	Mat CMarker::getPalette(const Mat &cellData, int dstC, int depth)
+	{
+		const int C = cellData.channels();
+		Mat res;
+		if (dstC == C) cellData.convertTo(res, depth);
+		else {
+			Mat colors(cellData.size(), CV_64FC(dstC));
+			const double *pSrc = cellData.ptr<double>(0);
+			double		 *pDst = colors.ptr<double>(0);
+			for (int idx = 0; idx < cellData.cols; idx++) {
+				const double *src = pSrc + C * idx;
+				double		 *dst = pDst + dstC * idx;
+				if (C == 1) for (int c = 0; c < dstC; c++) dst[c] = src[0];
+				else dst[0] = 0.114 * src[0] + 0.587 * src[1] + 0.299 * src[2];			// BGR to gray
+			}
+			colors.convertTo(res, depth);
+		}
+		return res;
+	}
 }
\ No newline at end of file
@@ -3,14 +3,17 @@
 #pragma once
 
 #include "types.h"
+#include <map>
 
 namespace HexagonCells
 {
+	class CCell;
 
 	// ================================ Marker Class ================================
 	/**
 	@brief Marker class
 	@details This class allows to visualize the hexagonical cells
+	@note The class caches the rasterized grids, thus one instance may not be used from several threads simultaneously
 	@author Sergey G. Kosov, sergey.kosov@project-10.de
 	*/
 	class CMarker
@@ -21,11 +24,18 @@ namespace HexagonCells
 
 		/**
 		@brief Draws the hexagonical grid on the image.
-		@param[in,out] img The image
+		@details The anti-aliased grid for the given image size, radius and line thickness is rasterized only once into a coverage mask,
+		which is cached by the class; on every call the mask is alpha-blended onto the image.
+		@param[in,out] img The image. If it is a gray-scale image, it is converted to a 3-channel RGB image first
 		@param[in] R Hexagon outer radius
 		@param[in] color Grid color
+		@param[in] thickness Grid line thickness
 		*/
-		DllExport void markGrid(Mat &img, double R, CvScalar color);
+		DllExport void markGrid(Mat &img, double R, CvScalar color, int thickness = 1);
+		/**
+		@brief Releases the cached grid masks and interpolation tables
+		*/
+		DllExport void clearCache(void) { m_mGrid.clear(); m_mTriangles.clear(); }
 
 		/**
 		@brief Draws a single filled hexagon
@@ -35,5 +45,46 @@ namespace HexagonCells
 		@param[in] color Cell color
 		*/
 		DllExport void markHexagon(Mat &img, double R, int idx, CvScalar color);
+
+		/**
+		@brief Draws all the hexagons, filled with their colors
+		@details Every pixel is set to the color of the cell, it belongs to, according to the look-up table of the \b cell. Thus, in
+		contrast to @ref markHexagon(), the hexagons match exactly the cells, used for the calculation of the cell colors. The image
+		is drawn in one parallel pass.
+		@param[in,out] img The image. It may be the image of the \b cell itself (in-place drawing) or any other image of the same size
+		(out-of-place drawing). If it is empty or has another size, it is (re-) allocated as an 8-bit image with the number of
+		channels of the \b cell image. If \b img has 1 channel and the cells are colored, the cell luminance is drawn; if the cells
+		have 1 channel, the value is replicated into all the channels of \b img.
+		@param[in] cell The cells
+		@note If the \b cell uses a view of \b img (Ref. @ref CCell::bindImage()), the cell colors must be calculated before
+		\b img is modified; this function does it itself
+		*/
+		DllExport void markHexagons(Mat &img, CCell &cell);
+		/**
+		@brief Reconstructs a smooth image from the cell colors
+		@details Every pixel is interpolated barycentrically between the three nearest cell centres (Ref. @ref CCell::idx2d()), i.e.
+		the vertices of the triangle of the centre lattice, which contains the pixel; the pixels beyond the outer centres take the
+		colors of the border cells. The triangle indexes and weights of every pixel depend only on the grid, thus they are calculated
+		only once for the given image size and radius and cached by the class; on every call the image is gathered from the cell colors
+		in one parallel pass.
+		@param[out] img The image. If it is empty or has another size, it is (re-) allocated as an 8-bit image with the number of
+		channels of the \b cell image. The channel conversion rules are the same as for @ref markHexagons()
+		@param[in] cell The cells
+		*/
+		DllExport void reconstruct(Mat &img, CCell &cell);
+
+
+	private:
+		typedef std::pair<std::pair<std::pair<int, int>, double>, std::pair<int, int>>	grid_key_t;		// ((width, height), R), (thickness, channels)
+		typedef std::pair<std::pair<int, int>, double>									tri_key_t;		// (width, height), R
+
+		static void drawGrid(Mat &img, double R, CvScalar color, int thickness);
+		static void calculateTriangles(CvSize imgSize, double R, int nCells, vec_mat_t &vTriangles);
+		static Mat	getPalette(const Mat &cellData, int dstC, int depth);
+
+
+	private:
+		std::map<grid_key_t, Mat>		m_mGrid;		// Cached grid coverage masks Mat(imgSize, CV_8UC(channels))
+		std::map<tri_key_t, vec_mat_t>	m_mTriangles;	// Cached interpolation tables: 3 vertex indexes Mat(imgSize, CV_32SC1) and 3 weights Mat(imgSize, CV_32FC1)
 	};
 }
\ No newline at end of file
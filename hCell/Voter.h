@@ -0,0 +1,82 @@
+// Majority Voter class
+#pragma once
+
+#include "types.h"
+#include <algorithm>
+#include <climits>
+
+namespace HexagonCells
+{
+	// ================================ Voter Class ================================
+	/**
+	@brief Majority voter over the values of a cell channel
+	@details The value, which reaches the maximal count first in the raster order, wins, \a i.e. among the most frequent values the one
+	with the earliest last occurrence. The generic voter sorts the (value, position) pairs; NaN values are ordered after all the other
+	values and vote as one value.
+	@note The class is used internally by the cell classes
+	*/
+	template <typename T>
+	class CVoter
+	{
+	public:
+		T vote(const T *pBegin, const T *pEnd, int C)
+		{
+			m_vPairs.clear();
+			int pos = 0;
+			for (const T *pVal = pBegin; pVal < pEnd; pVal += C) m_vPairs.push_back(std::make_pair(*pVal, pos++));
+			std::sort(m_vPairs.begin(), m_vPairs.end(), [](const std::pair<T, int> &a, const std::pair<T, int> &b) {
+				return less(a.first, b.first) || (!less(b.first, a.first) && (a.second < b.second));
+			});
+
+			T	res		 = T();
+			int	maxCount = 0;
+			int	minLast	 = INT_MAX;
+			for (size_t i = 0; i < m_vPairs.size(); ) {
+				size_t j = i + 1;
+				while ((j < m_vPairs.size()) && !less(m_vPairs[i].first, m_vPairs[j].first)) j++;
+				int count = static_cast<int>(j - i);
+				int last  = m_vPairs[j - 1].second;
+				if ((count > maxCount) || ((count == maxCount) && (last < minLast))) {
+					res		 = m_vPairs[i].first;
+					maxCount = count;
+					minLast	 = last;
+				}
+				i = j;
+			}
+			return res;
+		}
+
+	private:
+		static inline bool less(T a, T b) { return (a < b) || ((a == a) && (b != b)); }
+
+	private:
+		std::vector<std::pair<T, int>>	m_vPairs;
+	};
+
+	/**
+	@brief Majority voter over the 8-bit values of a cell channel
+	@details The vote is replayed with a histogram
+	*/
+	template <>
+	class CVoter<byte>
+	{
+	public:
+		CVoter(void) { memset(m_hist, 0, sizeof(m_hist)); }
+
+		byte vote(const byte *pBegin, const byte *pEnd, int C)
+		{
+			byte res	= 0;
+			int	 maxVal = 0;
+			for (const byte *pVal = pBegin; pVal < pEnd; pVal += C)
+				if (++m_hist[*pVal] > maxVal) {
+					maxVal++;
+					res = *pVal;
+				}
+			for (const byte *pVal = pBegin; pVal < pEnd; pVal += C) m_hist[*pVal] = 0;
+			return res;
+		}
+
+	private:
+		int m_hist[256];
+	};
+}
@@ -2,6 +2,11 @@
 
 #include "../hCell/Cell.h"
 #include "../hCell/Marker.h"
+#include "../hCell/LUTCache.h"
+#include "../hCell/CellStream.h"
+#include "../hCell/CellReader.h"
+#include "../hCell/CellBatch.h"
+#include "../hCell/CellPyramid.h"
 
 /**
 @mainpage Introduction
@@ -18,6 +23,11 @@ as follows: \f$ r = \frac{\sqrt{3}}{2}R \f$. Thus the hexagon area \f$S = 3rR =
 The library consists of the following classes:
 - Cell generation and neighbourhood definition @ref HexagonCells::CCell
 - Visualization @ref HexagonCells::CMarker
+- Process-wide sharing and on-disk persistence of the look-up tables @ref HexagonCells::CLUTCache
+- Bounded-memory cell generation for images, given as a sequence of strips @ref HexagonCells::CCellStream
+- Memory-mapped access to the saved cell data @ref HexagonCells::CCellReader
+- Parallel cell generation for many images of the same size @ref HexagonCells::CCellBatch
+- Hierarchy of the hexagonal grids with the radii R, 2R, 4R, ... @ref HexagonCells::CCellPyramid
 
 
 @section s3 Installation
@@ -47,7 +57,7 @@ The documentation for hCell consists of one demo, introducing the basic function
 
 @page demo Demo Code
 In this demo, we show a very simple example of using our library: a test image will be pixelized with hexagonical patches. First, an image is opened and class instanses 
-@ref HexagonCells::CCell and @ref HexagonCells::CMarker are created and initialized. Then, after the number of cells in image is known, we draw hexagons upon the image and show it. After a keypress, 
+@ref HexagonCells::CCell and @ref HexagonCells::CMarker are created and initialized. Then we draw the hexagons, filled with the cell colors, upon the image and show it. After a keypress, 
 the application exits.
 @code
 #include "hCell.h"
@@ -73,12 +83,8 @@ int main ()
 	Mat img = imread("test_image.jpg", 1);
 	cell.setImage(img);
 	
-	// Achieving the number of hexagons, corresponding to the input image
-	cell_params params = cell.getInfo();
-	
 	// Drawing solid hexagons on the same input image
-	for (register int n = 0; n < params.N; n++)
-		marker.markHexagon(img, R, n, cell.getVal(n)); 
+	marker.markHexagons(img, cell);
 
 	// Optinally mark the drawn hexagons with a grid of custom color
 	marker.markGrid(img, R, CV_RGB(0, 128, 64));
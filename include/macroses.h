@@ -1,5 +1,11 @@
 #pragma once
 
+// AVX2 code paths are compiled in, if the compiler supports the intrinsics; they are selected at run-time
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || defined(__AVX2__)
+#define ENABLE_AVX2
+#include <immintrin.h>
+#endif
+
 #define __ATTRIBUTES__ " in \"" __FILE__ "\", line " _CRT_STRINGIZE(__LINE__) ""
 #define HCELL_ASSERT(_condition_) \
 	do { \